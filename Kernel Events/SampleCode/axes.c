@@ -0,0 +1,127 @@
+/* Snapshot of every absolute axis a device supports
+ *
+ * See axes.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "axes.h"
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
+
+static const char * const abs_names[ABS_CNT] = {
+	[ABS_X] = "X Axis",
+	[ABS_Y] = "Y Axis",
+	[ABS_Z] = "Z Axis",
+	[ABS_RX] = "RX",
+	[ABS_RY] = "RY",
+	[ABS_RZ] = "RZ",
+	[ABS_THROTTLE] = "Throttle",
+	[ABS_RUDDER] = "Rudder",
+	[ABS_WHEEL] = "Wheel",
+	[ABS_GAS] = "Gas",
+	[ABS_BRAKE] = "Brake",
+	[ABS_HAT0X] = "Hat 0X",
+	[ABS_HAT0Y] = "Hat 0Y",
+	[ABS_PRESSURE] = "Pressure",
+	[ABS_DISTANCE] = "Distance",
+	[ABS_TILT_X] = "Tilt X",
+	[ABS_TILT_Y] = "Tilt Y",
+	[ABS_TOOL_WIDTH] = "Tool Width",
+	[ABS_VOLUME] = "Volume",
+	[ABS_MISC] = "Misc",
+	[ABS_MT_SLOT] = "MT Slot",
+	[ABS_MT_TOUCH_MAJOR] = "MT Touch Major",
+	[ABS_MT_TOUCH_MINOR] = "MT Touch Minor",
+	[ABS_MT_WIDTH_MAJOR] = "MT Width Major",
+	[ABS_MT_WIDTH_MINOR] = "MT Width Minor",
+	[ABS_MT_ORIENTATION] = "MT Orientation",
+	[ABS_MT_POSITION_X] = "MT Position X",
+	[ABS_MT_POSITION_Y] = "MT Position Y",
+	[ABS_MT_TOOL_TYPE] = "MT Tool Type",
+	[ABS_MT_BLOB_ID] = "MT Blob ID",
+	[ABS_MT_TRACKING_ID] = "MT Tracking ID",
+	[ABS_MT_PRESSURE] = "MT Pressure",
+	[ABS_MT_DISTANCE] = "MT Distance",
+	[ABS_MT_TOOL_X] = "MT Tool X",
+	[ABS_MT_TOOL_Y] = "MT Tool Y",
+};
+
+const char *axis_name(int code)
+{
+	if (code < 0 || code >= ABS_CNT || !abs_names[code])
+		return NULL;
+	return abs_names[code];
+}
+
+int axis_set_init(struct axis_set *set, int fd)
+{
+	unsigned long bits[NBITS(ABS_CNT)];
+	unsigned int i;
+	int n = 0;
+
+	memset(set, 0, sizeof(*set));
+	memset(bits, 0, sizeof(bits));
+	set->fd = fd;
+
+	if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(bits)), bits) < 0) {
+		perror("EVIOCGBIT");
+		return -1;
+	}
+
+	/* visit set bits only: ctz finds the lowest one, w &= w - 1
+	 * clears it */
+	for (i = 0; i < NBITS(ABS_CNT); i++) {
+		unsigned long w = bits[i];
+
+		while (w) {
+			set->axes[n++].code = i * BITS_PER_LONG + __builtin_ctzl(w);
+			w &= w - 1;
+		}
+	}
+	set->count = n;
+
+	if (axis_set_update(set) < 0)
+		return -1;
+
+	return set->count;
+}
+
+int axis_set_update(struct axis_set *set)
+{
+	struct input_absinfo abs;
+	int i;
+
+	for (i = 0; i < set->count; i++) {
+		struct axis_info *a = &set->axes[i];
+
+		if (ioctl(set->fd, EVIOCGABS(a->code), &abs) < 0) {
+			perror("EVIOCGABS error");
+			return -1;
+		}
+
+		a->value = abs.value;
+		a->minimum = abs.minimum;
+		a->maximum = abs.maximum;
+		a->fuzz = abs.fuzz;
+		a->flat = abs.flat;
+		a->resolution = abs.resolution;
+	}
+
+	return 0;
+}
+
+const struct axis_info *axis_set_find(const struct axis_set *set, int code)
+{
+	int i;
+
+	for (i = 0; i < set->count; i++)
+		if (set->axes[i].code == code)
+			return &set->axes[i];
+
+	return NULL;
+}
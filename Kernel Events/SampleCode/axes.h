@@ -0,0 +1,44 @@
+/* Snapshot of every absolute axis a device supports
+ *
+ * The EV_ABS bitmap is read once and its set bits are turned into a
+ * compact list of axis codes, so a snapshot is exactly one EVIOCGABS
+ * per supported axis (pen, tilt, distance, wheel, MT, ...) and nothing
+ * is spent on codes the device doesn't have.
+ */
+
+#ifndef AXES_H
+#define AXES_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+struct axis_info {
+	uint16_t code;
+	int32_t value;
+	int32_t minimum;
+	int32_t maximum;
+	int32_t fuzz;
+	int32_t flat;
+	int32_t resolution;
+};
+
+struct axis_set {
+	int fd;
+	int count;
+	struct axis_info axes[ABS_CNT];
+};
+
+/* Read the EV_ABS bitmap and take the first snapshot. Returns the
+ * number of axes or -1.
+ */
+int axis_set_init(struct axis_set *set, int fd);
+
+/* Refresh value and ranges of every axis in the set */
+int axis_set_update(struct axis_set *set);
+
+/* The axis with the given code, NULL if the device doesn't have it */
+const struct axis_info *axis_set_find(const struct axis_set *set, int code);
+
+const char *axis_name(int code);
+
+#endif /* AXES_H */
@@ -0,0 +1,196 @@
+/* Device capability snapshot with an on-disk cache
+ *
+ * See caps.h. The cache file is a small header followed by an array of
+ * struct device_caps. It is read whole and replaced whole through a
+ * temporary file and rename(), so readers never see a partial update.
+ * A kernel update or a change of the struct layout invalidates it.
+ *
+ * The cache is in a directory only root can write to, and a file that
+ * doesn't belong to us or that others can write is ignored: a planted
+ * cache would make callers trust capabilities the device doesn't have.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <linux/input.h>
+
+#include "caps.h"
+
+#define CAPS_MAGIC	"WACOMCAP"
+
+struct caps_cache_header {
+	char magic[8];
+	uint32_t size;		/* sizeof(struct device_caps) */
+	uint32_t count;
+	char release[65];	/* uname -r the snapshots were taken on */
+	char reserved[7];
+};
+
+static int caps_identify(int fd, struct device_caps *caps)
+{
+	memset(caps, 0, sizeof(*caps));
+
+	if (ioctl(fd, EVIOCGID, &caps->id) < 0)
+		return -1;
+
+	/* phys and uniq are optional, an error just leaves them empty */
+	ioctl(fd, EVIOCGNAME(sizeof(caps->name) - 1), caps->name);
+	ioctl(fd, EVIOCGPHYS(sizeof(caps->phys) - 1), caps->phys);
+	ioctl(fd, EVIOCGUNIQ(sizeof(caps->uniq) - 1), caps->uniq);
+	return 0;
+}
+
+static int caps_probe_bits(int fd, struct device_caps *caps)
+{
+	int type, code;
+
+	ioctl(fd, EVIOCGPROP(sizeof(caps->props)), caps->props);
+
+	if (ioctl(fd, EVIOCGBIT(0, sizeof(caps->bits[0])), caps->bits[0]) < 0)
+		return -1;
+
+	for (type = 1; type < EV_CNT; type++)
+		if (caps_test_bit(caps->bits[0], type))
+			ioctl(fd, EVIOCGBIT(type, sizeof(caps->bits[type])),
+			      caps->bits[type]);
+
+	for (code = 0; code < ABS_CNT; code++)
+		if (caps_test_bit(caps->bits[EV_ABS], code))
+			ioctl(fd, EVIOCGABS(code), &caps->absinfo[code]);
+
+	return 0;
+}
+
+int caps_probe(int fd, struct device_caps *caps)
+{
+	if (caps_identify(fd, caps) < 0)
+		return -1;
+	return caps_probe_bits(fd, caps);
+}
+
+static int caps_same_device(const struct device_caps *a,
+			    const struct device_caps *b)
+{
+	return memcmp(&a->id, &b->id, sizeof(a->id)) == 0 &&
+	       strcmp(a->name, b->name) == 0 &&
+	       strcmp(a->phys, b->phys) == 0 &&
+	       strcmp(a->uniq, b->uniq) == 0;
+}
+
+/* Read all snapshots of a valid cache, returns the count or 0 */
+static uint32_t caps_read_cache(const char *path, const char *release,
+				struct device_caps *entries)
+{
+	struct caps_cache_header h;
+	struct stat st;
+	FILE *f;
+	uint32_t count = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	    st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+	    !(f = fdopen(fd, "rb"))) {
+		close(fd);
+		return 0;
+	}
+
+	if (fread(&h, sizeof(h), 1, f) == 1 &&
+	    memcmp(h.magic, CAPS_MAGIC, sizeof(h.magic)) == 0 &&
+	    h.size == sizeof(struct device_caps) &&
+	    h.count <= CAPS_CACHE_MAX &&
+	    strncmp(h.release, release, sizeof(h.release)) == 0 &&
+	    fread(entries, sizeof(*entries), h.count, f) == h.count)
+		count = h.count;
+
+	fclose(f);
+	return count;
+}
+
+static int caps_write_cache(const char *path, const char *release,
+			    const struct device_caps *entries, uint32_t count)
+{
+	struct caps_cache_header h;
+	char tmp[4096];
+	FILE *f;
+	int fd;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CAPS_MAGIC, sizeof(h.magic));
+	h.size = sizeof(struct device_caps);
+	h.count = count;
+	snprintf(h.release, sizeof(h.release), "%s", release);
+
+	/* a new file, never one somebody put a symlink in place of */
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0 || !(f = fdopen(fd, "wb"))) {
+		perror(tmp);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmp);
+		}
+		return -1;
+	}
+
+	if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+	    fwrite(entries, sizeof(*entries), count, f) != count ||
+	    fclose(f) != 0 ||
+	    rename(tmp, path) < 0) {
+		perror(path);
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+int caps_load(int fd, struct device_caps *caps, const char *cache_path)
+{
+	struct device_caps *entries;
+	struct utsname uts;
+	uint32_t i, count;
+	int rc;
+
+	if (caps_identify(fd, caps) < 0)
+		return -1;
+
+	uname(&uts);
+	entries = malloc(CAPS_CACHE_MAX * sizeof(*entries));
+	if (!entries)
+		return caps_probe_bits(fd, caps) < 0 ? -1 : CAPS_MISS;
+
+	count = caps_read_cache(cache_path, uts.release, entries);
+	for (i = 0; i < count; i++) {
+		if (caps_same_device(&entries[i], caps)) {
+			*caps = entries[i];
+			free(entries);
+			return CAPS_HIT;
+		}
+	}
+
+	if (caps_probe_bits(fd, caps) < 0) {
+		free(entries);
+		return -1;
+	}
+
+	/* newest first, the oldest snapshot falls off a full cache */
+	if (count == CAPS_CACHE_MAX)
+		count--;
+	memmove(&entries[1], &entries[0], count * sizeof(*entries));
+	entries[0] = *caps;
+	rc = caps_write_cache(cache_path, uts.release, entries, count + 1);
+
+	free(entries);
+	return rc < 0 ? CAPS_MISS : CAPS_STORED;
+}
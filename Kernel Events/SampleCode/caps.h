@@ -0,0 +1,55 @@
+/* Device capability snapshot with an on-disk cache
+ *
+ * A full snapshot takes one EVIOCGBIT per supported event type and one
+ * EVIOCGABS per axis. caps_load() first reads only the identity of the
+ * device (EVIOCGID, EVIOCGNAME, EVIOCGPHYS and EVIOCGUNIQ) and, if a
+ * snapshot with the same identity was taken under the same kernel
+ * release, uses that one instead of asking the device again.
+ *
+ * Cached absinfo carries the axis value from when the snapshot was
+ * taken; the ranges, fuzz, flat and resolution don't change.
+ */
+
+#ifndef CAPS_H
+#define CAPS_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+#define CAPS_BITS_SIZE		((KEY_MAX + 1) / 8)
+#define CAPS_CACHE_PATH		"/var/cache/wacom-caps.cache"	/* root only */
+#define CAPS_CACHE_MAX		64	/* snapshots kept in the cache */
+
+struct device_caps {
+	/* identity, compared on load */
+	struct input_id id;
+	char name[256];
+	char phys[64];
+	char uniq[64];
+
+	/* snapshot, bitmaps as EVIOCGBIT returns them */
+	uint8_t props[INPUT_PROP_CNT / 8];
+	uint8_t bits[EV_CNT][CAPS_BITS_SIZE];
+	struct input_absinfo absinfo[ABS_CNT];
+};
+
+static inline int caps_test_bit(const uint8_t *bits, int bit)
+{
+	return (bits[bit / 8] >> (bit % 8)) & 1;
+}
+
+/* Query everything from the device */
+int caps_probe(int fd, struct device_caps *caps);
+
+/* caps_load() results besides -1 */
+#define CAPS_MISS		0	/* probed, the cache could not be updated */
+#define CAPS_HIT		1	/* from the cache */
+#define CAPS_STORED		2	/* probed and added to the cache */
+
+/* Use the cached snapshot if the device identity matches, otherwise
+ * probe and store the result. Returns CAPS_HIT, CAPS_STORED or
+ * CAPS_MISS, or -1 if the device could not be queried.
+ */
+int caps_load(int fd, struct device_caps *caps, const char *cache_path);
+
+#endif /* CAPS_H */
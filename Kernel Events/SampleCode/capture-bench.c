@@ -0,0 +1,145 @@
+/* Compare the cost of the epoll and io_uring capture backends
+ *
+ * to compile:
+ *  gcc -o capture-bench capture-bench.c capture.c uring-capture.c
+ *
+ * to run:
+ *  feed the nodes with a high event rate, e.g. replay a recording
+ *  unthrottled with event-replay.c:
+ *  sudo ./event-replay -f -l 1000 capture.rec &
+ *
+ *  then measure every Wacom node, 10 seconds per backend:
+ *  sudo ./capture-bench
+ *
+ *  or only some nodes, for N seconds each:
+ *  sudo ./capture-bench -t N /dev/input/eventX /dev/input/eventY
+ *
+ * Each backend opens the nodes afresh and reads them for the given
+ * time without doing anything with the events. Printed per backend:
+ * events per second, system calls per second (epoll_wait + read, or
+ * io_uring_enter), wakeups and voluntary context switches per 1000
+ * events. With a single busy node both are close; the io_uring
+ * backend pulls ahead as more nodes are active at the same time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <linux/input.h>
+
+#include "capture.h"
+#include "uring-capture.h"
+
+static void discard_events(struct capture_device *dev,
+			   const struct input_event *events, int count,
+			   void *data)
+{
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_devices(struct capture *cap, int argc, char *argv[])
+{
+	int i;
+
+	if (capture_init(cap) < 0)
+		return -1;
+
+	if (argc == 0)
+		return capture_add_wacom_devices(cap) > 0 ? 0 : -1;
+
+	for (i = 0; i < argc; i++)
+		if (!capture_add_device(cap, argv[i]))
+			return -1;
+
+	return 0;
+}
+
+static int run(const char *backend, int use_uring, double seconds,
+	       int argc, char *argv[])
+{
+	struct capture cap;
+	struct uring_capture uc;
+	struct rusage before, after;
+	double start, elapsed;
+	unsigned long csw, events;
+	int n = 0;
+
+	if (open_devices(&cap, argc, argv) < 0) {
+		fprintf(stderr, "no devices to read\n");
+		return -1;
+	}
+
+	if (use_uring && uring_capture_init(&uc, &cap) < 0) {
+		capture_close(&cap);
+		return -1;
+	}
+
+	getrusage(RUSAGE_SELF, &before);
+	start = now();
+
+	while (n >= 0 && cap.nopen > 0 && now() - start < seconds) {
+		if (use_uring)
+			n = uring_capture_dispatch(&uc, 100, discard_events, NULL);
+		else
+			n = capture_dispatch(&cap, 100, discard_events, NULL);
+	}
+
+	elapsed = now() - start;
+	getrusage(RUSAGE_SELF, &after);
+
+	/* after the clock stopped, so printing isn't measured */
+	if (n < 0)
+		perror(use_uring ? "io_uring_enter" : "epoll_wait");
+	capture_report_removed(&cap);
+
+	csw = after.ru_nvcsw - before.ru_nvcsw;
+	events = cap.stats.events ? cap.stats.events : 1;
+
+	printf("%-8s %10lu %12.0f %12.0f %12.2f %12.2f\n",
+		backend,
+		cap.stats.events,
+		cap.stats.events / elapsed,
+		cap.stats.syscalls / elapsed,
+		cap.stats.wakeups * 1000.0 / events,
+		csw * 1000.0 / events);
+
+	if (use_uring)
+		uring_capture_close(&uc);
+	capture_close(&cap);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	double seconds = 10;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:h")) != -1) {
+		if (opt == 't') {
+			seconds = atof(optarg);
+		} else {
+			fprintf(stderr, "Usage: %s [-t seconds] [/dev/input/eventX ...]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	printf("%-8s %10s %12s %12s %12s %12s\n", "backend", "events",
+	       "events/s", "syscalls/s", "wakeups/1k", "csw/1k");
+
+	if (run("epoll", 0, seconds, argc - optind, argv + optind) < 0)
+		exit(1);
+	if (run("io_uring", 1, seconds, argc - optind, argv + optind) < 0)
+		exit(1);
+
+	return 0;
+}
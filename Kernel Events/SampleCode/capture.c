@@ -0,0 +1,227 @@
+/* epoll based capture engine shared by the kernel event samples
+ *
+ * See capture.h. The device scan is the same one devices.c does: every
+ * /dev/input/event* node is opened and kept if EVIOCGNAME starts with
+ * "Wacom".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/input.h>
+
+#include "capture.h"
+
+int capture_init(struct capture *cap)
+{
+	memset(cap, 0, sizeof(*cap));
+
+	cap->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (cap->epfd < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+
+	return 0;
+}
+
+void capture_remove_device(struct capture *cap, struct capture_device *dev)
+{
+	epoll_ctl(cap->epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+	close(dev->fd);
+	dev->fd = -1;
+	cap->nopen--;
+}
+
+void capture_close(struct capture *cap)
+{
+	int i;
+
+	for (i = 0; i < cap->ndevices; i++)
+		if (cap->devices[i].fd >= 0)
+			capture_remove_device(cap, &cap->devices[i]);
+
+	close(cap->epfd);
+	cap->epfd = -1;
+}
+
+static struct capture_device *capture_add_fd(struct capture *cap, int fd,
+					     const char *path, const char *name)
+{
+	struct capture_device *dev;
+	struct epoll_event ev;
+
+	if (cap->ndevices >= CAPTURE_MAX_DEVICES) {
+		fprintf(stderr, "%s: too many devices\n", path);
+		return NULL;
+	}
+
+	dev = &cap->devices[cap->ndevices];
+	dev->fd = fd;
+	dev->error = 0;
+	dev->reported = 0;
+	dev->index = cap->ndevices;
+	snprintf(dev->path, sizeof(dev->path), "%s", path);
+	snprintf(dev->name, sizeof(dev->name), "%s", name);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = dev;
+	if (epoll_ctl(cap->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		perror("epoll_ctl");
+		return NULL;
+	}
+
+	cap->ndevices++;
+	cap->nopen++;
+	return dev;
+}
+
+struct capture_device *capture_add_device(struct capture *cap, const char *path)
+{
+	struct capture_device *dev;
+	char name[256] = "???";
+	int fd;
+
+	fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror(path);
+		return NULL;
+	}
+
+	ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+
+	dev = capture_add_fd(cap, fd, path, name);
+	if (!dev)
+		close(fd);
+
+	return dev;
+}
+
+static int is_event_device(const struct dirent *dir) {
+	return strncmp("event", dir->d_name, 5) == 0;
+}
+
+int capture_add_wacom_devices(struct capture *cap)
+{
+	struct dirent **namelist;
+	int i, ndev, added = 0;
+
+	ndev = scandir("/dev/input", &namelist, is_event_device, alphasort);
+	if (ndev < 0) {
+		perror("/dev/input");
+		return 0;
+	}
+
+	for (i = 0; i < ndev; i++) {
+		char fname[300];
+		char name[256] = "???";
+		int fd;
+
+		snprintf(fname, sizeof(fname),
+			 "%s/%s", "/dev/input", namelist[i]->d_name);
+		free(namelist[i]);
+
+		fd = open(fname, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+
+		if (strncmp("Wacom", name, 5) == 0 &&
+		    capture_add_fd(cap, fd, fname, name))
+			added++;
+		else
+			close(fd);
+	}
+	free(namelist);
+
+	return added;
+}
+
+/* Read up to CAPTURE_MAX_BATCHES batches from one ready device */
+static int capture_drain(struct capture *cap, struct capture_device *dev,
+			 capture_func func, void *data)
+{
+	struct input_event events[CAPTURE_BATCH];
+	int batch, count, total = 0;
+	ssize_t sz;
+
+	for (batch = 0; batch < CAPTURE_MAX_BATCHES; batch++) {
+		sz = read(dev->fd, events, sizeof(events));
+		cap->stats.syscalls++;
+		if (sz < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+			/* ENODEV: the device was unplugged */
+			dev->error = errno;
+			capture_remove_device(cap, dev);
+			break;
+		}
+
+		count = sz / sizeof(struct input_event);
+		if (count == 0) {
+			/* end of file, only seen when replaying from a pipe */
+			capture_remove_device(cap, dev);
+			break;
+		}
+
+		func(dev, events, count, data);
+		total += count;
+
+		/* a short read means the kernel buffer is empty */
+		if (count < CAPTURE_BATCH)
+			break;
+	}
+
+	return total;
+}
+
+int capture_dispatch(struct capture *cap, int timeout,
+		     capture_func func, void *data)
+{
+	struct epoll_event ready[CAPTURE_MAX_DEVICES];
+	int i, n, total = 0;
+
+	n = epoll_wait(cap->epfd, ready, CAPTURE_MAX_DEVICES, timeout);
+	cap->stats.syscalls++;
+	if (n < 0) {
+		if (errno == EINTR)
+			return 0;
+		return -1;
+	}
+
+	if (n > 0)
+		cap->stats.wakeups++;
+
+	for (i = 0; i < n; i++) {
+		struct capture_device *dev = ready[i].data.ptr;
+
+		if (dev->fd < 0)
+			continue;
+		total += capture_drain(cap, dev, func, data);
+	}
+
+	cap->stats.events += total;
+	return total;
+}
+
+void capture_report_removed(struct capture *cap)
+{
+	int i;
+
+	for (i = 0; i < cap->ndevices; i++) {
+		struct capture_device *dev = &cap->devices[i];
+
+		if (dev->fd >= 0 || dev->reported)
+			continue;
+		if (dev->error)
+			fprintf(stderr, "%s: %s\n", dev->path, strerror(dev->error));
+		dev->reported = 1;
+	}
+}
@@ -0,0 +1,80 @@
+/* epoll based capture engine shared by the kernel event samples
+ *
+ * One thread follows any number of /dev/input/eventX nodes. Every node
+ * is opened non-blocking and registered with a single epoll instance;
+ * when a node becomes readable it is drained in batches of
+ * CAPTURE_BATCH events and each batch is handed to a callback together
+ * with the device it came from.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <linux/input.h>
+
+#define CAPTURE_MAX_DEVICES	64
+#define CAPTURE_BATCH		128
+
+/* Upper bound of batches read from one node per wakeup, so a busy
+ * device can't starve the others. Whatever is left over is picked up
+ * on the next capture_dispatch() since epoll is level triggered.
+ */
+#define CAPTURE_MAX_BATCHES	4
+
+struct capture_device {
+	int fd;			/* -1 once the device is gone */
+	int error;		/* errno that closed it, 0: end of file */
+	int reported;		/* set by whoever told the user it is gone */
+	int index;		/* position in capture.devices */
+	char path[300];
+	char name[256];
+};
+
+/* Cost of a capture backend, see capture-bench.c */
+struct capture_stats {
+	unsigned long syscalls;	/* epoll_wait, read or io_uring_enter */
+	unsigned long wakeups;	/* waits that returned with something to do */
+	unsigned long events;
+};
+
+struct capture {
+	int epfd;
+	int ndevices;		/* slots used, including removed devices */
+	int nopen;		/* devices still open */
+	struct capture_device devices[CAPTURE_MAX_DEVICES];
+	struct capture_stats stats;
+};
+
+typedef void (*capture_func)(struct capture_device *dev,
+			     const struct input_event *events, int count,
+			     void *data);
+
+int capture_init(struct capture *cap);
+void capture_close(struct capture *cap);
+
+/* Open one node and add it to the engine, returns the device or NULL */
+struct capture_device *capture_add_device(struct capture *cap, const char *path);
+
+/* Close a device that failed or went away */
+void capture_remove_device(struct capture *cap, struct capture_device *dev);
+
+/* Add every /dev/input/event* node whose name starts with "Wacom",
+ * returns the number of devices added
+ */
+int capture_add_wacom_devices(struct capture *cap);
+
+/* Wait up to timeout ms and deliver every batch that is ready.
+ * Returns the number of events delivered or -1 with errno set.
+ *
+ * Nothing on this path prints, so it may run on a real-time thread: a
+ * device that fails is closed with its errno left in error, for the
+ * caller to report from wherever output is allowed.
+ */
+int capture_dispatch(struct capture *cap, int timeout,
+		     capture_func func, void *data);
+
+/* Print every device that went away since the last call, for callers
+ * that dispatch and print on the same thread */
+void capture_report_removed(struct capture *cap);
+
+#endif /* CAPTURE_H */
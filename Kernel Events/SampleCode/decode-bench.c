@@ -0,0 +1,316 @@
+/* Compare the per-event pen decoding loop with the batch column decoder
+ *
+ * to compile:
+ *  gcc -O2 -o decode-bench decode-bench.c event-columns.c pen-frame.c \
+ *      recording.c caps.c
+ *
+ * to run:
+ *  decode a recording made with event-log -w, 1000 times per decoder:
+ *  ./decode-bench -r capture.rec
+ *
+ *  or N synthetic pen reports (default 4000), I times per decoder:
+ *  ./decode-bench [-n N] [-i I]
+ *
+ * The events are loaded into memory first, so only decoding is timed.
+ * Keep the input small enough for the cache, or reading it from memory
+ * is what gets measured.
+ * Reports are decoded into blocks of -b frames (default 4096) that are
+ * reused, the way a streaming consumer would, so the output stays in
+ * the cache and the numbers show the decoders rather than memory
+ * bandwidth. The reference is the loop pressure.c runs,
+ * pen_assembler_feed() for every event with the frames stored as
+ * structs, followed by the scalar, SSE4.1 and AVX2 kernels of
+ * event-columns.c, as far as the CPU supports them. The best of the
+ * runs is printed for each, and the columns of every kernel are checked
+ * against the reference.
+ *
+ * With small blocks (-b 7, say) every call stops a few reports in. The
+ * vector kernels classify about as many events as the remaining frames
+ * need, going by the events per frame seen so far, but still lose more
+ * to the two passes than the scalar loop does, so they fall further
+ * behind it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+#include "event-columns.h"
+#include "pen-frame.h"
+#include "recording.h"
+
+struct events {
+	struct input_event *ev;
+	size_t count;
+	size_t size;
+	uint32_t nframes;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int append(struct events *e, uint64_t t, uint16_t type, uint16_t code,
+		  int32_t value)
+{
+	struct input_event *ev;
+
+	if (e->count == e->size) {
+		size_t size = e->size ? e->size * 2 : 4096;
+
+		ev = realloc(e->ev, size * sizeof(*ev));
+		if (!ev) {
+			perror("realloc");
+			return -1;
+		}
+		e->ev = ev;
+		e->size = size;
+	}
+
+	ev = &e->ev[e->count++];
+	ev->time.tv_sec = t / 1000000;
+	ev->time.tv_usec = t % 1000000;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+
+	if (type == EV_SYN && code == SYN_REPORT)
+		e->nframes++;
+	return 0;
+}
+
+/* A pen drawing circles at 200Hz, in and out of contact and proximity */
+static int synthesize(struct events *e, uint32_t nframes)
+{
+	uint64_t t = 1000000;
+	uint32_t f;
+	int rc = 0;
+
+	for (f = 0; f < nframes && rc == 0; f++, t += 5000) {
+		uint32_t phase = f % 400;
+
+		if (phase == 0) {
+			rc |= append(e, t, EV_KEY, BTN_TOOL_PEN, 1);
+			rc |= append(e, t, EV_ABS, ABS_MISC, 0x802);
+		}
+		if (phase == 20)
+			rc |= append(e, t, EV_KEY, BTN_TOUCH, 1);
+		if (phase == 380)
+			rc |= append(e, t, EV_KEY, BTN_TOUCH, 0);
+
+		if (phase == 399) {
+			rc |= append(e, t, EV_KEY, BTN_TOOL_PEN, 0);
+			rc |= append(e, t, EV_ABS, ABS_MISC, 0);
+		} else {
+			rc |= append(e, t, EV_ABS, ABS_X, 10000 + (f * 37) % 20000);
+			rc |= append(e, t, EV_ABS, ABS_Y, 8000 + (f * 53) % 16000);
+			if (phase >= 20 && phase < 380)
+				rc |= append(e, t, EV_ABS, ABS_PRESSURE, (f * 11) % 8192);
+			rc |= append(e, t, EV_ABS, ABS_TILT_X, (int32_t) (f % 120) - 60);
+			rc |= append(e, t, EV_ABS, ABS_TILT_Y, (int32_t) (f % 90) - 45);
+			rc |= append(e, t, EV_ABS, ABS_DISTANCE, phase < 20 ? 20 - phase : 0);
+		}
+		rc |= append(e, t, EV_MSC, MSC_SERIAL, 0x1234abcd);
+		rc |= append(e, t, EV_MSC, MSC_TIMESTAMP, (int32_t) (t & 0x7fffffff));
+		rc |= append(e, t, EV_SYN, SYN_REPORT, 0);
+	}
+
+	return rc;
+}
+
+static int load_recording(struct events *e, const char *path)
+{
+	struct input_event frame[REC_MAX_FRAME_EVENTS + 1];
+	struct rec_reader rec;
+	int i, count;
+
+	if (rec_reader_open(&rec, path) < 0)
+		return -1;
+
+	while ((count = rec_reader_next(&rec, frame, REC_MAX_FRAME_EVENTS + 1)) > 0) {
+		for (i = 0; i < count; i++)
+			if (append(e, rec_time_us(&frame[i].time), frame[i].type,
+				   frame[i].code, frame[i].value) < 0)
+				break;
+		if (i < count) {
+			/* append() already said why */
+			rec_reader_close(&rec);
+			return -1;
+		}
+	}
+
+	rec_reader_close(&rec);
+	if (count < 0)
+		fprintf(stderr, "%s: corrupt recording\n", path);
+	return count;
+}
+
+static void print_result(const char *name, const struct events *e,
+			 double best, double reference)
+{
+	printf("%-10s %8.2f ns/event %8.1f Mevents/s %6.2fx\n", name,
+	       best * 1e9 / e->count, e->count / best / 1e6, reference / best);
+}
+
+static double run_branchy(const struct events *e, struct pen_frame *frames,
+			  uint32_t block, int iterations)
+{
+	struct pen_assembler pa;
+	double best = 0, t;
+	uint32_t n;
+	size_t i;
+	int it;
+
+	for (it = 0; it < iterations; it++) {
+		pen_assembler_init(&pa, -1);
+		n = 0;
+		t = now();
+		for (i = 0; i < e->count; i++)
+			if (pen_assembler_feed(&pa, &e->ev[i], &frames[n]) &&
+			    ++n == block)
+				n = 0;
+		t = now() - t;
+		if (it == 0 || t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+static double run_columns(const struct events *e, struct event_columns *ec,
+			  int iterations)
+{
+	double best = 0, t;
+	size_t done;
+	int it;
+
+	for (it = 0; it < iterations; it++) {
+		memset(ec->state, 0, sizeof(ec->state));
+		event_columns_clear(ec);
+		t = now();
+		for (done = 0; done < e->count; ) {
+			done += event_columns_decode(ec, e->ev + done, e->count - done);
+			if (ec->nframes == ec->max_frames)
+				event_columns_clear(ec);
+		}
+		t = now() - t;
+		if (it == 0 || t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/* Same values as the struct per frame the reference produced? */
+static int check(const struct event_columns *ec, const struct pen_frame *frames,
+		 uint32_t nframes)
+{
+	uint32_t f;
+
+	if (ec->nframes != nframes)
+		return -1;
+
+	for (f = 0; f < nframes; f++) {
+		const struct pen_frame *p = &frames[f];
+
+		if (ec->columns[EC_X][f] != p->x ||
+		    ec->columns[EC_Y][f] != p->y ||
+		    ec->columns[EC_PRESSURE][f] != p->pressure ||
+		    ec->columns[EC_TILT_X][f] != p->tilt_x ||
+		    ec->columns[EC_TILT_Y][f] != p->tilt_y ||
+		    ec->columns[EC_DISTANCE][f] != p->distance ||
+		    ec->columns[EC_TOOL_ID][f] != p->tool_id ||
+		    (uint32_t) ec->columns[EC_SERIAL][f] != p->serial ||
+		    ec->columns[EC_TOUCH][f] != !!(p->buttons & PEN_BUTTON_TOUCH) ||
+		    ec->time_us[f] != (int64_t) rec_time_us(&p->time))
+			return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const enum ec_kernel kernels[] = {
+		EC_KERNEL_SCALAR, EC_KERNEL_SSE4, EC_KERNEL_AVX2,
+	};
+	struct events e = { 0 };
+	struct pen_frame *frames;
+	struct event_columns ec;
+	const char *path = NULL;
+	uint32_t nframes = 4000, block = 4096;
+	double reference, best;
+	int iterations = 1000;
+	unsigned int k;
+	int opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "r:n:i:b:h")) != -1) {
+		switch (opt) {
+			case 'r': path = optarg; break;
+			case 'n': nframes = strtoul(optarg, NULL, 0); break;
+			case 'i': iterations = atoi(optarg); break;
+			case 'b': block = strtoul(optarg, NULL, 0); break;
+			default:
+				fprintf(stderr, "Usage: %s [-r capture.rec | -n frames] [-i iterations] [-b block]\n",
+					argv[0]);
+				exit(1);
+		}
+	}
+
+	if (iterations < 1)
+		iterations = 1;
+	if (block < 1)
+		block = 1;
+
+	if (path ? load_recording(&e, path) < 0 : synthesize(&e, nframes) < 0)
+		exit(1);
+	if (!e.nframes) {
+		fprintf(stderr, "no reports to decode\n");
+		exit(1);
+	}
+
+	printf("%zu events, %u reports, %d runs each\n", e.count, e.nframes, iterations);
+
+	frames = calloc(e.nframes, sizeof(*frames));
+	if (!frames) {
+		perror("calloc");
+		exit(1);
+	}
+
+	reference = run_branchy(&e, frames, block, iterations);
+	print_result("per-event", &e, reference, reference);
+
+	/* all frames, once, to check the kernels against */
+	run_branchy(&e, frames, e.nframes, 1);
+
+	for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+		if (event_columns_init(&ec, block, kernels[k]) < 0)
+			continue;
+
+		best = run_columns(&e, &ec, iterations);
+		print_result(ec.kernel, &e, best, reference);
+		event_columns_free(&ec);
+
+		if (event_columns_init(&ec, e.nframes, kernels[k]) < 0)
+			continue;
+		event_columns_decode(&ec, e.ev, e.count);
+		if (check(&ec, frames, e.nframes) < 0) {
+			fprintf(stderr, "%s: columns differ from the per-event decoder\n",
+				ec.kernel);
+			rc = 1;
+		}
+
+		event_columns_free(&ec);
+	}
+
+	free(frames);
+	free(e.ev);
+	return rc;
+}
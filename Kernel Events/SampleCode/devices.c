@@ -9,9 +9,16 @@
  * Modified from evtest.c by Aaron Armstrong Skomra
  * 
  * Compile:
- *	gcc -o devices devices.c 
+ *	gcc -o devices devices.c registry.c
  * Run:
  *	sudo ./devices
+ *
+ * Or keep running and report Wacom nodes as they come and go:
+ *	sudo ./devices -f
+ *
+ * The nodes are tracked by registry.c: /dev/input is scanned once,
+ * after that only the nodes inotify or a kernel uevent report as added
+ * or removed are looked at again.
  */
 
 /*
@@ -36,45 +43,46 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <fcntl.h> // for open
-#include <unistd.h> // for close
 #include <string.h>
-#include <dirent.h>
+#include <poll.h>
 #include <linux/input.h>
 
-static int is_event_device(const struct dirent *dir) {
-        return strncmp("event", dir->d_name, 5) == 0;
+#include "registry.h"
+
+static void device_added(struct registry *reg,
+			 const struct registry_device *dev, void *data)
+{
+	fprintf(stderr, "%s:    %s\n", dev->path, dev->name);
+}
+
+static void device_removed(struct registry *reg,
+			   const struct registry_device *dev, void *data)
+{
+	fprintf(stderr, "%s:    %s (removed)\n", dev->path, dev->name);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-        struct dirent **namelist;
-        int i, ndev, devnum;
-        char *filename;
+	struct registry reg;
+	struct pollfd fds[2];
+	int follow = argc > 1 && strcmp(argv[1], "-f") == 0;
 
-        ndev = scandir("/dev/input", &namelist, is_event_device, 0);
-        if (ndev <= 0)
-                return -1;
+	if (registry_init(&reg, 1, device_added, device_removed, NULL) < 0)
+		return -1;
 
-        for (i = 0; i < ndev; i++)
-        {
-                char fname[300];
-                int fd = -1;
-                char name[256] = "???";
+	if (!follow) {
+		registry_close(&reg);
+		return reg.npresent > 0 ? 0 : -1;
+	}
 
-                snprintf(fname, sizeof(fname),
-                         "%s/%s", "/dev/input", namelist[i]->d_name);
-                fd = open(fname, O_RDONLY);
-                if (fd < 0)
-                        continue;
-                ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+	fds[0].fd = reg.inotify_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = reg.uevent_fd;	/* poll ignores it if it is -1 */
+	fds[1].events = POLLIN;
 
-		if (strncmp("Wacom", name, 5) == 0)
-                	fprintf(stderr, "%s:    %s\n", fname, name);
-                close(fd);
-                free(namelist[i]);
-        }
+	while (poll(fds, 2, -1) >= 0)
+		registry_dispatch(&reg);
 
-        return 0;
+	registry_close(&reg);
+	return 0;
 }
-
@@ -0,0 +1,434 @@
+/* Batch decoder from input_event arrays into per-axis columns
+ *
+ * See event-columns.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/input.h>
+
+#include "event-columns.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EC_X86
+#include <immintrin.h>
+#endif
+
+/* Lookup table index of an event:
+ *   0..63   EV_ABS code
+ *   64..95  EV_KEY code - BTN_DIGI (the BTN_TOOL_* and stylus buttons)
+ *   96..103 EV_MSC code
+ *   127     anything else
+ */
+#define EC_INDEX_KEY	64
+#define EC_INDEX_MSC	96
+#define EC_INDEX_NONE	127
+#define EC_INDEX_SIZE	128
+
+static int32_t ec_table[EC_INDEX_SIZE];
+
+static void ec_init_table(void)
+{
+	int i;
+
+	for (i = 0; i < EC_INDEX_SIZE; i++)
+		ec_table[i] = EC_NONE;
+
+	ec_table[ABS_X] = EC_X;
+	ec_table[ABS_Y] = EC_Y;
+	ec_table[ABS_PRESSURE] = EC_PRESSURE;
+	ec_table[ABS_TILT_X] = EC_TILT_X;
+	ec_table[ABS_TILT_Y] = EC_TILT_Y;
+	ec_table[ABS_DISTANCE] = EC_DISTANCE;
+	ec_table[ABS_WHEEL] = EC_WHEEL;
+	ec_table[ABS_MISC] = EC_TOOL_ID;
+	ec_table[EC_INDEX_KEY + BTN_TOUCH - BTN_DIGI] = EC_TOUCH;
+	ec_table[EC_INDEX_KEY + BTN_STYLUS - BTN_DIGI] = EC_STYLUS;
+	ec_table[EC_INDEX_KEY + BTN_STYLUS2 - BTN_DIGI] = EC_STYLUS2;
+	ec_table[EC_INDEX_KEY + BTN_TOOL_PEN - BTN_DIGI] = EC_TOOL_PEN;
+	ec_table[EC_INDEX_KEY + BTN_TOOL_RUBBER - BTN_DIGI] = EC_TOOL_RUBBER;
+	ec_table[EC_INDEX_MSC + MSC_SERIAL] = EC_SERIAL;
+	ec_table[EC_INDEX_MSC + MSC_TIMESTAMP] = EC_TIMESTAMP;
+}
+
+static inline int ec_index(uint16_t type, uint16_t code)
+{
+	if (type == EV_ABS && code < EC_INDEX_KEY)
+		return code;
+	if (type == EV_KEY && (uint16_t) (code - BTN_DIGI) < EC_INDEX_MSC - EC_INDEX_KEY)
+		return EC_INDEX_KEY + code - BTN_DIGI;
+	if (type == EV_MSC && code < 8)
+		return EC_INDEX_MSC + code;
+	return EC_INDEX_NONE;
+}
+
+/* Column numbers past the sink, only used inside the decoder */
+#define EC_EMIT		(EC_NONE + 1)	/* SYN_REPORT */
+#define EC_DROP		(EC_NONE + 2)	/* SYN_DROPPED */
+#define EC_NSTATE	(EC_NONE + 3)
+
+/* Column of an event, EC_EMIT and EC_DROP included */
+static inline int ec_classify(const struct input_event *ev)
+{
+	if (ev->type == EV_SYN && ev->code == SYN_REPORT)
+		return EC_EMIT;
+	if (ev->type == EV_SYN && ev->code == SYN_DROPPED)
+		return EC_DROP;
+	return ec_table[ec_index(ev->type, ev->code)];
+}
+
+/* Decoder state for the duration of one call. Working on a local copy
+ * lets the compiler keep it out of memory that the column stores could
+ * alias, the values are written back to event_columns at the end.
+ */
+struct ec_cursor {
+	int32_t state[EC_NSTATE];
+	int32_t *columns[EC_NCOLUMNS];
+	int64_t *time_us;
+	uint32_t nframes;
+	uint32_t max_frames;
+	unsigned long ndropped;
+};
+
+static inline void ec_begin(struct ec_cursor *cur, const struct event_columns *ec)
+{
+	memcpy(cur->state, ec->state, sizeof(ec->state));
+	memcpy(cur->columns, ec->columns, sizeof(cur->columns));
+	cur->time_us = ec->time_us;
+	cur->nframes = ec->nframes;
+	cur->max_frames = ec->max_frames;
+	cur->ndropped = ec->ndropped;
+}
+
+static inline void ec_end(const struct ec_cursor *cur, struct event_columns *ec)
+{
+	memcpy(ec->state, cur->state, sizeof(ec->state));
+	ec->nframes = cur->nframes;
+	ec->ndropped = cur->ndropped;
+}
+
+/* Append the current state as a frame, returns 1 if the columns are full */
+static inline int ec_emit(struct ec_cursor *cur, const struct input_event *ev)
+{
+	uint32_t n = cur->nframes++;
+	int c;
+
+	cur->time_us[n] = (int64_t) ev->time.tv_sec * 1000000 + ev->time.tv_usec;
+	for (c = 0; c < EC_NCOLUMNS; c++)
+		cur->columns[c][n] = cur->state[c];
+
+	return cur->nframes == cur->max_frames;
+}
+
+/* Store every event's value in its column, emitting a frame at each
+ * SYN_REPORT. col holds the column of each event, worked out by
+ * ec_classify() or a vector kernel. Returns the number of events
+ * consumed, less than count if the columns filled up.
+ */
+static inline size_t ec_scatter(struct ec_cursor *cur,
+				const struct input_event *events,
+				const uint8_t *col, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		int c = col[i];
+
+		cur->state[c] = events[i].value;
+		if (c < EC_EMIT)
+			continue;
+		if (c == EC_DROP)
+			cur->ndropped++;
+		else if (ec_emit(cur, &events[i]))
+			return i + 1;
+	}
+
+	return count;
+}
+
+static size_t ec_decode_scalar(struct event_columns *ec,
+			       const struct input_event *events, size_t count)
+{
+	struct ec_cursor cur;
+	size_t i;
+	int c;
+
+	if (ec->nframes == ec->max_frames)
+		return 0;
+
+	ec_begin(&cur, ec);
+
+	for (i = 0; i < count; i++) {
+		c = ec_classify(&events[i]);
+		cur.state[c] = events[i].value;
+		if (c == EC_DROP)
+			cur.ndropped++;
+		else if (c == EC_EMIT && ec_emit(&cur, &events[i])) {
+			i++;
+			break;
+		}
+	}
+
+	ec_end(&cur, ec);
+	return i;
+}
+
+#ifdef EC_X86
+
+/* The vector kernels work in two passes over blocks of EC_BLOCK events:
+ * the columns of all events are worked out without a single branch,
+ * then ec_scatter() stores the values. The second pass is the scalar
+ * loop minus the type and code tests, which are what the branch
+ * predictor gets wrong in a mixed stream.
+ */
+#define EC_BLOCK	256
+
+/* type | code << 16 as the vector kernels see it */
+#define EC_SYN_REPORT	(EV_SYN | SYN_REPORT << 16)
+#define EC_SYN_DROPPED	(EV_SYN | SYN_DROPPED << 16)
+
+/* type | code << 16 of 4 events. type, code and value are the last 8
+ * bytes of an event, one 64 bit load per event and a shuffle pick the
+ * type and code out.
+ */
+static inline __m128i ec_load4(const struct input_event *ev)
+{
+	__m128i a = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) &ev[0].type),
+				       _mm_loadl_epi64((const __m128i *) &ev[1].type));
+	__m128i b = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) &ev[2].type),
+				       _mm_loadl_epi64((const __m128i *) &ev[3].type));
+
+	return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+					       _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+__attribute__((target("sse4.1")))
+static void ec_classify_sse4(const struct input_event *events, size_t count,
+			     uint8_t *col)
+{
+	const __m128i mask16 = _mm_set1_epi32(0xffff);
+	int32_t idx[4], col32;
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		__m128i tc, type, code, key, is_abs, is_key, is_msc, index, c;
+
+		tc = ec_load4(&events[i]);
+		type = _mm_and_si128(tc, mask16);
+		code = _mm_srli_epi32(tc, 16);
+		key = _mm_sub_epi32(code, _mm_set1_epi32(BTN_DIGI));
+
+		is_abs = _mm_and_si128(_mm_cmpeq_epi32(type, _mm_set1_epi32(EV_ABS)),
+				       _mm_cmplt_epi32(code, _mm_set1_epi32(EC_INDEX_KEY)));
+		is_key = _mm_and_si128(_mm_cmpeq_epi32(type, _mm_set1_epi32(EV_KEY)),
+				       _mm_and_si128(_mm_cmpgt_epi32(key, _mm_set1_epi32(-1)),
+						     _mm_cmplt_epi32(key, _mm_set1_epi32(EC_INDEX_MSC - EC_INDEX_KEY))));
+		is_msc = _mm_and_si128(_mm_cmpeq_epi32(type, _mm_set1_epi32(EV_MSC)),
+				       _mm_cmplt_epi32(code, _mm_set1_epi32(8)));
+
+		index = _mm_set1_epi32(EC_INDEX_NONE);
+		index = _mm_blendv_epi8(index, code, is_abs);
+		index = _mm_blendv_epi8(index, _mm_add_epi32(key, _mm_set1_epi32(EC_INDEX_KEY)), is_key);
+		index = _mm_blendv_epi8(index, _mm_add_epi32(code, _mm_set1_epi32(EC_INDEX_MSC)), is_msc);
+		_mm_storeu_si128((__m128i *) idx, index);
+
+		/* no gather before AVX2 */
+		c = _mm_setr_epi32(ec_table[idx[0]], ec_table[idx[1]],
+				   ec_table[idx[2]], ec_table[idx[3]]);
+		c = _mm_blendv_epi8(c, _mm_set1_epi32(EC_EMIT),
+				    _mm_cmpeq_epi32(tc, _mm_set1_epi32(EC_SYN_REPORT)));
+		c = _mm_blendv_epi8(c, _mm_set1_epi32(EC_DROP),
+				    _mm_cmpeq_epi32(tc, _mm_set1_epi32(EC_SYN_DROPPED)));
+		c = _mm_packus_epi16(_mm_packs_epi32(c, c), c);
+		col32 = _mm_cvtsi128_si32(c);
+		memcpy(&col[i], &col32, sizeof(col32));
+	}
+
+	for (; i < count; i++)
+		col[i] = ec_classify(&events[i]);
+}
+
+__attribute__((target("avx2")))
+static void ec_classify_avx2(const struct input_event *events, size_t count,
+			     uint8_t *col)
+{
+	const __m256i mask16 = _mm256_set1_epi32(0xffff);
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m256i tc, type, code, key, is_abs, is_key, is_msc, index, c;
+		__m128i packed;
+
+		tc = _mm256_set_m128i(ec_load4(&events[i + 4]), ec_load4(&events[i]));
+		type = _mm256_and_si256(tc, mask16);
+		code = _mm256_srli_epi32(tc, 16);
+		key = _mm256_sub_epi32(code, _mm256_set1_epi32(BTN_DIGI));
+
+		is_abs = _mm256_and_si256(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(EV_ABS)),
+					  _mm256_cmpgt_epi32(_mm256_set1_epi32(EC_INDEX_KEY), code));
+		is_key = _mm256_and_si256(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(EV_KEY)),
+					  _mm256_and_si256(_mm256_cmpgt_epi32(key, _mm256_set1_epi32(-1)),
+							   _mm256_cmpgt_epi32(_mm256_set1_epi32(EC_INDEX_MSC - EC_INDEX_KEY), key)));
+		is_msc = _mm256_and_si256(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(EV_MSC)),
+					  _mm256_cmpgt_epi32(_mm256_set1_epi32(8), code));
+
+		index = _mm256_set1_epi32(EC_INDEX_NONE);
+		index = _mm256_blendv_epi8(index, code, is_abs);
+		index = _mm256_blendv_epi8(index, _mm256_add_epi32(key, _mm256_set1_epi32(EC_INDEX_KEY)), is_key);
+		index = _mm256_blendv_epi8(index, _mm256_add_epi32(code, _mm256_set1_epi32(EC_INDEX_MSC)), is_msc);
+
+		c = _mm256_i32gather_epi32(ec_table, index, 4);
+		c = _mm256_blendv_epi8(c, _mm256_set1_epi32(EC_EMIT),
+				       _mm256_cmpeq_epi32(tc, _mm256_set1_epi32(EC_SYN_REPORT)));
+		c = _mm256_blendv_epi8(c, _mm256_set1_epi32(EC_DROP),
+				       _mm256_cmpeq_epi32(tc, _mm256_set1_epi32(EC_SYN_DROPPED)));
+
+		/* one byte per event, 8 of them in one store */
+		packed = _mm_packs_epi32(_mm256_castsi256_si128(c),
+					 _mm256_extracti128_si256(c, 1));
+		_mm_storel_epi64((__m128i *) &col[i], _mm_packus_epi16(packed, packed));
+	}
+
+	for (; i < count; i++)
+		col[i] = ec_classify(&events[i]);
+}
+
+static inline size_t ec_decode_blocks(struct event_columns *ec,
+				      const struct input_event *events,
+				      size_t count,
+				      void (*classify)(const struct input_event *,
+						       size_t, uint8_t *))
+{
+	uint8_t col[EC_BLOCK];
+	struct ec_cursor cur;
+	uint32_t first = ec->nframes;
+	size_t i, n, left, done;
+
+	if (ec->nframes == ec->max_frames)
+		return 0;
+
+	ec_begin(&cur, ec);
+
+	for (i = 0; i < count; i += done) {
+		n = count - i < EC_BLOCK ? count - i : EC_BLOCK;
+
+		/* whatever is classified after the frame that fills the
+		 * columns is thrown away, so with few frames left only
+		 * classify about as many events as they will take; falling
+		 * short only costs another round */
+		if (ec->events_per_frame) {
+			left = (size_t) (cur.max_frames - cur.nframes) *
+			       ec->events_per_frame + 8;
+			if (n > left)
+				n = left;
+		}
+
+		classify(&events[i], n, col);
+		done = ec_scatter(&cur, &events[i], col, n);
+		if (done < n || cur.nframes == cur.max_frames) {
+			i += done;
+			break;
+		}
+	}
+
+	ec_end(&cur, ec);
+
+	if (ec->nframes > first)
+		ec->events_per_frame = (i + ec->nframes - first - 1) /
+				       (ec->nframes - first);
+	return i;
+}
+
+static size_t ec_decode_sse4(struct event_columns *ec,
+			     const struct input_event *events, size_t count)
+{
+	return ec_decode_blocks(ec, events, count, ec_classify_sse4);
+}
+
+static size_t ec_decode_avx2(struct event_columns *ec,
+			     const struct input_event *events, size_t count)
+{
+	return ec_decode_blocks(ec, events, count, ec_classify_avx2);
+}
+
+#endif /* EC_X86 */
+
+static int ec_select(struct event_columns *ec, enum ec_kernel kernel)
+{
+#ifdef EC_X86
+	int avx2 = __builtin_cpu_supports("avx2");
+	int sse4 = __builtin_cpu_supports("sse4.1");
+
+	/* the stores, not the classification, dominate: the table driven
+	 * scalar loop beats AVX2 in decode-bench and SSE4.1, without a
+	 * gather, beats neither. The vector kernels are only used when
+	 * asked for. */
+	if (kernel == EC_KERNEL_AUTO)
+		kernel = EC_KERNEL_SCALAR;
+
+	if (kernel == EC_KERNEL_AVX2 && avx2) {
+		ec->decode = ec_decode_avx2;
+		ec->kernel = "avx2";
+		return 0;
+	}
+	if (kernel == EC_KERNEL_SSE4 && sse4) {
+		ec->decode = ec_decode_sse4;
+		ec->kernel = "sse4.1";
+		return 0;
+	}
+#else
+	if (kernel == EC_KERNEL_AUTO)
+		kernel = EC_KERNEL_SCALAR;
+#endif
+
+	if (kernel != EC_KERNEL_SCALAR)
+		return -1;
+
+	ec->decode = ec_decode_scalar;
+	ec->kernel = "scalar";
+	return 0;
+}
+
+int event_columns_init(struct event_columns *ec, uint32_t max_frames,
+		       enum ec_kernel kernel)
+{
+	int32_t *data;
+	size_t stride;
+	int c;
+
+	memset(ec, 0, sizeof(*ec));
+	ec_init_table();
+
+	if (ec_select(ec, kernel) < 0) {
+		fprintf(stderr, "decoder not supported by this CPU\n");
+		return -1;
+	}
+
+	/* all columns in one allocation, one after the other. Columns a
+	 * multiple of 4k apart would land in the same cache set and evict
+	 * each other on every frame, so each is padded by a cache line. */
+	stride = (max_frames + 15) / 16 * 16 + 16;
+	data = calloc(stride * EC_NCOLUMNS, sizeof(int32_t));
+	ec->time_us = calloc(max_frames, sizeof(int64_t));
+	if (!data || !ec->time_us) {
+		perror("calloc");
+		free(data);
+		free(ec->time_us);
+		return -1;
+	}
+
+	for (c = 0; c < EC_NCOLUMNS; c++)
+		ec->columns[c] = data + c * stride;
+	ec->max_frames = max_frames;
+
+	return 0;
+}
+
+void event_columns_free(struct event_columns *ec)
+{
+	free(ec->columns[0]);
+	free(ec->time_us);
+	memset(ec->columns, 0, sizeof(ec->columns));
+	ec->time_us = NULL;
+}
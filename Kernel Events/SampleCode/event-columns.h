@@ -0,0 +1,98 @@
+/* Batch decoder from input_event arrays into per-axis columns
+ *
+ * Takes the events of one read() or of a whole mapped capture and, for
+ * every SYN_REPORT, appends the pen state of that report to one array
+ * per axis (structure of arrays), carrying values that didn't change
+ * from the previous report, as pen-frame.c does for a single frame.
+ *
+ * Instead of a switch on type and code per event, every event is
+ * turned into a column number through one lookup table; events nobody
+ * wants go to a sink column. On x86 the column numbers of a block of
+ * events are worked out 4 (SSE4.1) or 8 (AVX2) at a time without a
+ * branch first, then the values are stored in a second pass. They
+ * have to be asked for and are checked against what the CPU supports;
+ * EC_KERNEL_AUTO picks the scalar loop, which was the fastest in
+ * decode-bench.c.
+ *
+ * SYN_DROPPED is only counted: decoding is meant for recordings, and a
+ * live consumer can't resync from here anyway.
+ */
+
+#ifndef EVENT_COLUMNS_H
+#define EVENT_COLUMNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+enum ec_column {
+	EC_X,
+	EC_Y,
+	EC_PRESSURE,
+	EC_TILT_X,
+	EC_TILT_Y,
+	EC_DISTANCE,
+	EC_WHEEL,
+	EC_TOOL_ID,		/* ABS_MISC */
+	EC_TOUCH,		/* BTN_TOUCH */
+	EC_STYLUS,		/* BTN_STYLUS */
+	EC_STYLUS2,		/* BTN_STYLUS2 */
+	EC_TOOL_PEN,		/* BTN_TOOL_PEN */
+	EC_TOOL_RUBBER,		/* BTN_TOOL_RUBBER */
+	EC_SERIAL,		/* MSC_SERIAL */
+	EC_TIMESTAMP,		/* MSC_TIMESTAMP */
+	EC_NCOLUMNS,
+	EC_NONE = EC_NCOLUMNS	/* sink for events that aren't kept */
+};
+
+enum ec_kernel {
+	EC_KERNEL_AUTO,
+	EC_KERNEL_SCALAR,
+	EC_KERNEL_SSE4,
+	EC_KERNEL_AVX2,
+};
+
+struct event_columns;
+
+typedef size_t (*ec_decode_fn)(struct event_columns *ec,
+			       const struct input_event *events, size_t count);
+
+struct event_columns {
+	uint32_t max_frames;
+	uint32_t nframes;
+	int64_t *time_us;			/* time of each SYN_REPORT */
+	int32_t *columns[EC_NCOLUMNS];		/* columns[c][frame] */
+	int32_t state[EC_NCOLUMNS + 1];		/* current values, + sink */
+	unsigned long ndropped;			/* SYN_DROPPED seen */
+	uint32_t events_per_frame;		/* so far, sizes vector blocks */
+	ec_decode_fn decode;
+	const char *kernel;
+};
+
+/* Allocate room for max_frames reports. Returns -1 if the requested
+ * kernel isn't supported by this CPU or the allocation failed.
+ */
+int event_columns_init(struct event_columns *ec, uint32_t max_frames,
+		       enum ec_kernel kernel);
+void event_columns_free(struct event_columns *ec);
+
+/* Forget the decoded frames but keep the current state, so the next
+ * call carries on where the last one stopped.
+ */
+static inline void event_columns_clear(struct event_columns *ec)
+{
+	ec->nframes = 0;
+}
+
+/* Decode events until they are used up or the columns are full.
+ * Returns the number of events consumed; events after the SYN_REPORT
+ * that filled the columns are left for the next call.
+ */
+static inline size_t event_columns_decode(struct event_columns *ec,
+					  const struct input_event *events,
+					  size_t count)
+{
+	return ec->decode(ec, events, count);
+}
+
+#endif /* EVENT_COLUMNS_H */
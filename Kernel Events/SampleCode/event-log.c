@@ -1,52 +1,571 @@
 /* Print raw pen or expresskey kernel events
  *
  * to compile:
- *  gcc -o event-log event-log.c  
+ *  gcc -o event-log event-log.c capture.c uring-capture.c recording.c caps.c \
+ *      event-ring.c latency.c jitter.c histogram.c realtime.c -lpthread
  *
  * to run:
  *  find your device in /dev/input/...
  *  sudo ./event-log /dev/input/eventX
  *
+ *  or follow several nodes at once:
+ *  sudo ./event-log /dev/input/eventX /dev/input/eventY
+ *
+ *  or every Wacom node (pen, touch and pad of all tablets):
+ *  sudo ./event-log
+ *
+ *  record to a compact binary file instead of printing (see recording.h),
+ *  one file per node, suffixed with the node name if there is more than one:
+ *  sudo ./event-log -w capture.rec /dev/input/eventX
+ *
+ *  print a recording, optionally starting N seconds into it:
+ *  ./event-log -r capture.rec [-s N]
+ *
+ * The nodes are read on their own thread and the events handed to the
+ * printing thread through a ring of -q batches (default 256) of up to
+ * 128 events. If output can't keep up the ring overflows and the lost
+ * events are counted, but reading never stalls, so the kernel buffer
+ * doesn't overflow into SYN_DROPPED.
+ *
+ *  measure how long reports wait in the kernel before they are read,
+ *  instead of printing them; per-device histograms are printed every
+ *  N seconds (0: only on exit), on exit and when SIGUSR1 arrives:
+ *  sudo ./event-log -L 10
+ *  kill -USR1 $(pidof event-log)
+ *
+ *  analyze report intervals instead of printing: rate, jitter, gaps
+ *  longer than 2 x the usual interval, SYN_DROPPED and the tablet's own
+ *  MSC_TIMESTAMP clock against the kernel timestamps (see jitter.h);
+ *  the table is printed on exit and when SIGUSR1 arrives:
+ *  sudo ./event-log -J 2
+ *
+ *  read the nodes through io_uring instead of epoll and read(), one
+ *  system call per wakeup however many nodes have events (see
+ *  uring-capture.h and capture-bench.c):
+ *  sudo ./event-log -u
+ *
+ *  run the reader as a real-time thread: SCHED_FIFO priority 50 on CPU 2,
+ *  all memory locked and prefaulted, and report every SYN_REPORT that
+ *  took more than 500us from the kernel timestamp into the ring
+ *  (default budget 1000us, see realtime.h):
+ *  sudo ./event-log -R 50 -c 2 -b 500
+ *
  * hint: compile and run devices.c first to find the /dev/input/eventX
  * that your pen and/or expresskey is associated with
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/input.h>
 
-int main (int argc, const char * argv[]) {
+#include "capture.h"
+#include "uring-capture.h"
+#include "recording.h"
+#include "event-ring.h"
+#include "latency.h"
+#include "jitter.h"
+#include "realtime.h"
+
+#if CAPTURE_BATCH > EVENT_RING_BATCH
+#error "a capture batch must fit into a ring slot"
+#endif
+
+/* event_batch.device of the batch that tells main a snapshot of the
+ * histograms is ready, see hand_over_stats() */
+#define STATS_BATCH	-1
+
+struct event_log {
+	int tagged;		/* prefix events with the source node */
+	struct capture *cap;
+	struct uring_capture *uring;	/* NULL: epoll backend */
+	struct event_ring ring;
+	struct rec_writer *writers[CAPTURE_MAX_DEVICES];
+	int latency_interval;	/* -1 if not measuring latency */
+	struct latency latency;
+	int analyze_jitter;
+	struct jitter jitter;
+	/* copies the reader hands to main for printing */
+	struct latency latency_stats;
+	struct jitter jitter_stats;
+	int stats_latency;	/* what the last STATS_BATCH carries */
+	int stats_jitter;
+	atomic_int stats_busy;	/* main hasn't printed the copies yet */
+	int error;		/* errno that stopped the reader */
+	int rt_priority;	/* 0 if not running real-time */
+	int rt_cpu;		/* -1: any CPU */
+	struct rt_deadline deadline;
+	unsigned long missed_reported;
+};
+
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t dump_stats = 0;
+
+static void sighandler(int signal)
+{
+	if (signal == SIGUSR1)
+		dump_stats = 1;
+	else
+		running = 0;
+}
+
+static uint64_t now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static void print_event(const char *tag, const struct input_event *ev)
+{
+	/* with more than one node, prefix each event with its source */
+	if (tag)
+		printf("%s: ", tag);
+
+	printf("%ld.%06ld type %d code %d value %d\n",
+		ev->time.tv_sec,
+		ev->time.tv_usec,
+		ev->type,
+		ev->code,
+		ev->value);
+}
+
+/* Reader thread: only moves events from the nodes into the ring */
+static void queue_events(struct capture_device *dev,
+			 const struct input_event *events, int count,
+			 void *data)
+{
+	struct event_log *log = data;
 
-	int fd = -1;
-	size_t sz;
-	struct input_event events[128];
+	if (log->latency_interval >= 0)
+		latency_record(&log->latency, dev, events, count);
+	if (log->analyze_jitter)
+		jitter_record(&log->jitter, dev, events, count);
+	if (log->rt_priority)
+		rt_deadline_check(&log->deadline, events, count);
+
+	event_ring_push(&log->ring, dev->index, events, count);
+}
+
+/* Reader thread: tell main about devices that went away. A device the
+ * ring has no room for is tried again after the next dispatch. */
+static void hand_over_removed(struct event_log *log)
+{
+	struct event_batch *batch;
 	int i;
 
-	if ((fd = open(argv[1], O_RDONLY)) < 0) {
-		perror("fd open error!");
-		exit(1);
+	for (i = 0; i < log->cap->ndevices; i++) {
+		struct capture_device *dev = &log->cap->devices[i];
+
+		if (dev->fd >= 0 || dev->reported)
+			continue;
+
+		batch = event_ring_reserve(&log->ring);
+		if (!batch)
+			return;
+		batch->device = dev->index;
+		batch->count = 0;
+		event_ring_commit(&log->ring);
+		dev->reported = 1;
 	}
+}
+
+/* Reader thread: copy the histograms into the buffers main prints from.
+ * Returns 0 if main is still printing the last copies or the ring is
+ * full, the caller tries again after the next dispatch.
+ */
+static int hand_over_stats(struct event_log *log, int latency, int jitter)
+{
+	struct event_batch *batch;
+
+	if (atomic_load_explicit(&log->stats_busy, memory_order_acquire))
+		return 0;
 
-	while (1) {
-		sz = read(fd, events, sizeof(struct input_event) * 128);
+	batch = event_ring_reserve(&log->ring);
+	if (!batch)
+		return 0;
 
-		if (sz < (int) sizeof(struct input_event)) {
-			perror("size error!");
-			exit (1);
+	if (latency)
+		latency_copy(&log->latency_stats, &log->latency);
+	if (jitter)
+		jitter_copy(&log->jitter_stats, &log->jitter);
+	log->stats_latency = latency;
+	log->stats_jitter = jitter;
+	atomic_store_explicit(&log->stats_busy, 1, memory_order_relaxed);
+
+	/* the commit publishes the copies along with the batch */
+	batch->device = STATS_BATCH;
+	batch->count = 0;
+	event_ring_commit(&log->ring);
+	return 1;
+}
+
+static void *reader_thread(void *data)
+{
+	struct event_log *log = data;
+	uint64_t next_dump = now_sec() + log->latency_interval;
+	int latency_due = 0, jitter_due = 0;
+
+	if (log->rt_priority && rt_enter(log->rt_priority, log->rt_cpu) < 0) {
+		running = 0;
+		event_ring_close(&log->ring);
+		return NULL;
+	}
+
+	/* the timeout lets the thread notice that main wants to quit and
+	 * that a latency dump is due; the histograms belong to this thread,
+	 * main only prints copies of them */
+	while (running && log->cap->nopen > 0) {
+		int n;
+
+		if (log->uring)
+			n = uring_capture_dispatch(log->uring, 100, queue_events, log);
+		else
+			n = capture_dispatch(log->cap, 100, queue_events, log);
+		if (n < 0) {
+			log->error = errno;
+			break;
 		}
 
-		for (i = 0; i < (int) (sz / sizeof(struct input_event)); i++) {
+		hand_over_removed(log);
 
-                        printf("%ld.%06ld type %d code %d value %d\n",
-				events[i].time.tv_sec,
-				events[i].time.tv_usec,
-				events[i].type,
-				events[i].code,
-				events[i].value);
+		if (dump_stats) {
+			latency_due = log->latency_interval >= 0;
+			jitter_due = log->analyze_jitter;
+			dump_stats = 0;
 		}
+
+		if (log->latency_interval > 0 && now_sec() >= next_dump)
+			latency_due = 1;
+
+		if ((latency_due || jitter_due) &&
+		    hand_over_stats(log, latency_due, jitter_due)) {
+			if (latency_due)
+				next_dump = now_sec() + log->latency_interval;
+			latency_due = jitter_due = 0;
+		}
+	}
+
+	hand_over_removed(log);
+
+	event_ring_close(&log->ring);
+	return NULL;
+}
+
+/* Print the copies from hand_over_stats() and give them back */
+static void print_stats(struct event_log *log)
+{
+	if (log->stats_latency)
+		latency_print(stdout, &log->latency_stats, log->cap);
+	if (log->stats_jitter)
+		jitter_print(stdout, &log->jitter_stats, log->cap);
+	atomic_store_explicit(&log->stats_busy, 0, memory_order_release);
+}
+
+static void handle_batch(struct event_log *log, const struct event_batch *batch)
+{
+	struct capture_device *dev;
+	int i;
+
+	if (batch->lost)
+		fprintf(stderr, "%lu events dropped, output too slow\n", batch->lost);
+
+	if (batch->device == STATS_BATCH) {
+		print_stats(log);
+		return;
+	}
+
+	dev = &log->cap->devices[batch->device];
+
+	/* an empty batch: the reader closed the device */
+	if (batch->count == 0) {
+		if (dev->error)
+			fprintf(stderr, "%s: %s\n", dev->path, strerror(dev->error));
+		return;
+	}
+
+	if (log->writers[dev->index]) {
+		if (rec_writer_add(log->writers[dev->index], batch->events, batch->count) < 0) {
+			perror("recording");
+			running = 0;
+		}
+		return;
+	}
+
+	if (log->latency_interval >= 0 || log->analyze_jitter)
+		return;
+
+	for (i = 0; i < batch->count; i++)
+		print_event(log->tagged ? dev->path : NULL, &batch->events[i]);
+}
+
+/* Misses are counted by the reader and reported from here, so the
+ * real-time thread never blocks on output */
+static void report_deadlines(struct event_log *log)
+{
+	unsigned long missed;
+
+	missed = atomic_load_explicit(&log->deadline.missed, memory_order_acquire);
+	if (missed == log->missed_reported)
+		return;
+
+	fprintf(stderr, "%lu reports over the %lld us budget, worst %lld us\n",
+		missed - log->missed_reported,
+		(long long) log->deadline.budget_us,
+		(long long) atomic_load(&log->deadline.worst_us));
+	log->missed_reported = missed;
+}
+
+/* Returns once the ring is closed and empty or we are told to quit */
+static void drain_ring(struct event_log *log)
+{
+	struct event_batch *batch;
+
+	do {
+		while ((batch = event_ring_peek(&log->ring))) {
+			handle_batch(log, batch);
+			event_ring_release(&log->ring);
+			if (log->rt_priority)
+				report_deadlines(log);
+		}
+	} while (running && !atomic_load(&log->ring.closed));
+}
+
+static int open_writers(struct event_log *log, struct capture *cap,
+			const char *path)
+{
+	char fname[600];
+	int i;
+
+	for (i = 0; i < cap->ndevices; i++) {
+		struct capture_device *dev = &cap->devices[i];
+
+		if (cap->ndevices > 1)
+			snprintf(fname, sizeof(fname), "%s.%s", path,
+				 strrchr(dev->path, '/') + 1);
+		else
+			snprintf(fname, sizeof(fname), "%s", path);
+
+		log->writers[i] = malloc(sizeof(struct rec_writer));
+		if (!log->writers[i] ||
+		    rec_writer_open(log->writers[i], fname, dev->fd) < 0)
+			return -1;
+		fprintf(stderr, "%s: recording to %s\n", dev->path, fname);
+	}
+
+	return 0;
+}
+
+static void close_writers(struct event_log *log, struct capture *cap)
+{
+	int i;
+
+	for (i = 0; i < cap->ndevices; i++) {
+		if (!log->writers[i])
+			continue;
+		rec_writer_close(log->writers[i]);
+		free(log->writers[i]);
+		log->writers[i] = NULL;
+	}
+}
+
+static int print_recording(const char *path, double start)
+{
+	struct input_event events[REC_MAX_FRAME_EVENTS + 1];
+	struct rec_reader rec;
+	int i, count = 0;
+
+	if (rec_reader_open(&rec, path) < 0)
+		return 1;
+
+	fprintf(stderr, "%s: %s, %llu frames, %llu events\n", path,
+		rec.header->name,
+		(unsigned long long) rec.header->nframes,
+		(unsigned long long) rec.header->nevents);
+
+	if (start > 0 && rec.nindex > 0 &&
+	    rec_reader_seek(&rec, rec.index[0].time_us + (uint64_t) (start * 1000000)) < 0) {
+		fprintf(stderr, "%s: corrupt recording\n", path);
+		rec_reader_close(&rec);
+		return 1;
+	}
+
+	while (running && (count = rec_reader_next(&rec, events, REC_MAX_FRAME_EVENTS + 1)) > 0)
+		for (i = 0; i < count; i++)
+			print_event(NULL, &events[i]);
+
+	if (count < 0)
+		fprintf(stderr, "%s: corrupt recording\n", path);
+
+	rec_reader_close(&rec);
+	return count < 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-u] [-q depth] [-w file] [-L seconds] [-J factor]\n", name);
+	fprintf(stderr, "       %*s [-R priority [-c cpu] [-b budget-us]] [/dev/input/eventX ...]\n", (int) strlen(name), "");
+	fprintf(stderr, "       %s -r file [-s seconds]\n", name);
+}
+
+int main (int argc, char * argv[]) {
+
+	struct capture cap;
+	struct uring_capture uring;
+	struct event_log log;
+	struct sigaction sa;
+	sigset_t sigs, oldsigs;
+	pthread_t reader;
+	const char *record = NULL, *replay = NULL;
+	double start = 0;
+	int depth = EVENT_RING_DEPTH;
+	int use_uring = 0;
+	int budget = 1000;
+	int i, opt;
+
+	memset(&log, 0, sizeof(log));
+	log.latency_interval = -1;
+	log.rt_cpu = -1;
+
+	while ((opt = getopt(argc, argv, "q:w:r:s:L:J:R:c:b:uh")) != -1) {
+		switch (opt) {
+			case 'L': log.latency_interval = atoi(optarg); break;
+			case 'J':
+				log.analyze_jitter = 1;
+				log.jitter.gap_factor = atof(optarg);
+				break;
+			case 'q': depth = atoi(optarg); break;
+			case 'w': record = optarg; break;
+			case 'r': replay = optarg; break;
+			case 's': start = atof(optarg); break;
+			case 'u': use_uring = 1; break;
+			case 'R': log.rt_priority = atoi(optarg); break;
+			case 'c': log.rt_cpu = atoi(optarg); break;
+			case 'b': budget = atoi(optarg); break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	/* no SA_RESTART, so a signal interrupts epoll_wait */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	if (replay)
+		return print_recording(replay, start);
+
+	log.cap = &cap;
+
+	if (capture_init(&cap) < 0)
+		exit(1);
+
+	if (optind < argc) {
+		for (i = optind; i < argc; i++)
+			if (!capture_add_device(&cap, argv[i]))
+				exit(1);
+	} else if (capture_add_wacom_devices(&cap) == 0) {
+		fprintf(stderr, "no Wacom devices found\n");
+		exit(1);
+	}
+
+	log.tagged = cap.ndevices > 1;
+	if (log.tagged)
+		for (i = 0; i < cap.ndevices; i++)
+			fprintf(stderr, "%s:    %s\n",
+				cap.devices[i].path, cap.devices[i].name);
+
+	if (record && open_writers(&log, &cap, record) < 0)
+		exit(1);
+
+	if (log.latency_interval >= 0 &&
+	    (latency_init(&log.latency, &cap) < 0 ||
+	     latency_clone(&log.latency_stats, &log.latency) < 0))
+		exit(1);
+
+	if (log.analyze_jitter &&
+	    (jitter_init(&log.jitter, &cap, log.jitter.gap_factor > 1 ? log.jitter.gap_factor : 2) < 0 ||
+	     jitter_clone(&log.jitter_stats, &log.jitter) < 0))
+		exit(1);
+
+	if (event_ring_init(&log.ring, depth > 0 ? depth : 1) < 0)
+		exit(1);
+
+	if (use_uring) {
+		if (uring_capture_init(&uring, &cap) < 0)
+			exit(1);
+		log.uring = &uring;
+	}
+
+	/* last, once everything the reader touches is allocated */
+	if (log.rt_priority) {
+		rt_deadline_init(&log.deadline, &cap, budget);
+		if (rt_lock_memory() < 0)
+			exit(1);
+		rt_prefault(log.ring.slots, (log.ring.mask + 1) * sizeof(struct event_batch));
+	}
+
+	/* signals go to this thread, the reader polls the running flag */
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigaddset(&sigs, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+	if (pthread_create(&reader, NULL, reader_thread, &log) != 0) {
+		fprintf(stderr, "failed to start the reader thread\n");
+		exit(1);
+	}
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+	/* returns when the ring is closed or a signal arrived */
+	drain_ring(&log);
+	running = 0;
+	pthread_join(reader, NULL);
+	drain_ring(&log);
+
+	if (log.error)
+		fprintf(stderr, "%s: %s\n", log.uring ? "io_uring_enter" : "epoll_wait",
+			strerror(log.error));
+
+	fprintf(stderr, "ring: %zu batches, high water %zu, %lu overflows, %lu events lost\n",
+		log.ring.mask + 1, log.ring.high_water,
+		atomic_load(&log.ring.overflows), atomic_load(&log.ring.lost));
+
+	if (log.latency_interval >= 0) {
+		latency_print(stdout, &log.latency, &cap);
+		latency_free(&log.latency);
+		latency_free(&log.latency_stats);
+	}
+
+	if (log.analyze_jitter) {
+		jitter_print(stdout, &log.jitter, &cap);
+		jitter_free(&log.jitter);
+		jitter_free(&log.jitter_stats);
+	}
+
+	if (log.rt_priority) {
+		report_deadlines(&log);
+		fprintf(stderr, "deadline: %lu of %lu reports over %lld us, worst %lld us\n",
+			atomic_load(&log.deadline.missed),
+			atomic_load(&log.deadline.reports),
+			(long long) log.deadline.budget_us,
+			(long long) atomic_load(&log.deadline.worst_us));
 	}
 
+	close_writers(&log, &cap);
+	event_ring_free(&log.ring);
+	if (log.uring)
+		uring_capture_close(log.uring);
+	capture_close(&cap);
 	return 0;
 }
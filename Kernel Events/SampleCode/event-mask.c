@@ -0,0 +1,109 @@
+/* Kernel side event filtering
+ *
+ * See event-mask.h.
+ */
+
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "event-mask.h"
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+
+/* number of codes the kernel keeps a mask for, 0 if the type can't be masked */
+static unsigned int code_count(unsigned int type)
+{
+	switch (type) {
+	case EV_SYN:	return EV_CNT;	/* the mask of types */
+	case EV_KEY:	return KEY_CNT;
+	case EV_REL:	return REL_CNT;
+	case EV_ABS:	return ABS_CNT;
+	case EV_MSC:	return MSC_CNT;
+	case EV_SW:	return SW_CNT;
+	case EV_LED:	return LED_CNT;
+	case EV_SND:	return SND_CNT;
+	case EV_FF:	return FF_CNT;
+	default:	return 0;
+	}
+}
+
+static inline void set_bit(unsigned long *bits, unsigned int bit)
+{
+	bits[bit / BITS_PER_LONG] |= 1UL << (bit % BITS_PER_LONG);
+}
+
+static inline int test_bit(const unsigned long *bits, unsigned int bit)
+{
+	return (bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1;
+}
+
+void event_mask_init(struct event_mask *mask)
+{
+	memset(mask, 0, sizeof(*mask));
+	set_bit(mask->types, EV_SYN);
+}
+
+void event_mask_add(struct event_mask *mask, unsigned int type, unsigned int code)
+{
+	if (type >= EV_CNT || code >= KEY_CNT)
+		return;
+
+	set_bit(mask->types, type);
+	set_bit(mask->codes[type], code);
+}
+
+void event_mask_add_list(struct event_mask *mask, const struct event_code *list, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		event_mask_add(mask, list[i].type, list[i].code);
+}
+
+void event_mask_add_type(struct event_mask *mask, unsigned int type)
+{
+	if (type >= EV_CNT)
+		return;
+
+	set_bit(mask->types, type);
+	memset(mask->codes[type], 0xff, sizeof(mask->codes[type]));
+}
+
+int event_mask_test(const struct event_mask *mask, unsigned int type, unsigned int code)
+{
+	if (type == EV_SYN)
+		return 1;
+	if (type >= EV_CNT || !test_bit(mask->types, type))
+		return 0;
+
+	/* like the kernel: codes without a mask pass */
+	if (code >= code_count(type))
+		return 1;
+
+	return test_bit(mask->codes[type], code);
+}
+
+int event_mask_apply(const struct event_mask *mask, int fd)
+{
+	struct input_mask im;
+	unsigned int type;
+
+	/* per-type code masks first, then the type mask (type 0) that
+	 * switches filtering on; EV_SYN itself is never filtered */
+	for (type = EV_KEY; type < EV_CNT; type++) {
+		if (!code_count(type))
+			continue;
+
+		im.type = type;
+		im.codes_size = EVENT_MASK_LONGS(code_count(type)) * sizeof(long);
+		im.codes_ptr = (unsigned long) mask->codes[type];
+		if (ioctl(fd, EVIOCSMASK, &im) < 0)
+			return -1;
+	}
+
+	im.type = EV_SYN;
+	im.codes_size = sizeof(mask->types);
+	im.codes_ptr = (unsigned long) mask->types;
+	return ioctl(fd, EVIOCSMASK, &im) < 0 ? -1 : 0;
+}
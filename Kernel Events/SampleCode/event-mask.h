@@ -0,0 +1,48 @@
+/* Kernel side event filtering
+ *
+ * A consumer lists the (type, code) pairs it needs and event_mask_apply()
+ * hands that list to the kernel with EVIOCSMASK. Everything else
+ * (MSC_SERIAL, key repeats, axes nobody looks at, ...) is then never
+ * queued for this file descriptor, and a SYN_REPORT whose events were
+ * all filtered is dropped too, so a single-purpose monitor only wakes
+ * up for frames it cares about. The mask only affects this client,
+ * other readers of the node still get every event.
+ *
+ * EVIOCSMASK needs Linux 4.4. On older kernels event_mask_apply()
+ * fails and the consumer can filter with event_mask_test() instead.
+ */
+
+#ifndef EVENT_MASK_H
+#define EVENT_MASK_H
+
+#include <linux/input.h>
+
+#define EVENT_MASK_LONGS(x)	(((x) + sizeof(long) * 8 - 1) / (sizeof(long) * 8))
+
+struct event_mask {
+	unsigned long types[EVENT_MASK_LONGS(EV_CNT)];
+	unsigned long codes[EV_CNT][EVENT_MASK_LONGS(KEY_CNT)];
+};
+
+struct event_code {
+	unsigned short type;
+	unsigned short code;
+};
+
+/* Start with nothing subscribed but EV_SYN */
+void event_mask_init(struct event_mask *mask);
+
+void event_mask_add(struct event_mask *mask, unsigned int type, unsigned int code);
+void event_mask_add_list(struct event_mask *mask, const struct event_code *list, int n);
+
+/* Subscribe to every code of a type */
+void event_mask_add_type(struct event_mask *mask, unsigned int type);
+
+int event_mask_test(const struct event_mask *mask, unsigned int type, unsigned int code);
+
+/* Install the mask on fd. Returns 0, or -1 with errno set if the kernel
+ * doesn't support EVIOCSMASK.
+ */
+int event_mask_apply(const struct event_mask *mask, int fd);
+
+#endif /* EVENT_MASK_H */
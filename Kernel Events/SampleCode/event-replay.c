@@ -0,0 +1,248 @@
+/* Replay a recording through a virtual uinput device
+ *
+ * The device is cloned from the snapshot in the recording header (name,
+ * id, properties, capability bits and the absinfo of every axis, the
+ * same data supported-event-types.c and ioctl.c read from a live
+ * device), then the recorded frames are written to it either at their
+ * original pace or as fast as the kernel accepts them.
+ *
+ * to compile:
+ *  gcc -o event-replay event-replay.c recording.c caps.c
+ *
+ * to run:
+ *  record a device first with event-log.c:
+ *  sudo ./event-log -w capture.rec /dev/input/eventX
+ *
+ *  replay it at the original timing:
+ *  sudo ./event-replay capture.rec
+ *
+ *  or unthrottled, looping 10 times:
+ *  sudo ./event-replay -f -l 10 capture.rec
+ *
+ * The virtual device keeps the name and id of the recorded one, so
+ * the X driver and libinput treat it like the real tablet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "recording.h"
+
+static const struct {
+	int type;
+	int max;
+	unsigned long request;
+} code_bits[] = {
+	{ EV_KEY, KEY_MAX, UI_SET_KEYBIT },
+	{ EV_REL, REL_MAX, UI_SET_RELBIT },
+	{ EV_ABS, ABS_MAX, UI_SET_ABSBIT },
+	{ EV_MSC, MSC_MAX, UI_SET_MSCBIT },
+	{ EV_SW,  SW_MAX,  UI_SET_SWBIT },
+	{ EV_LED, LED_MAX, UI_SET_LEDBIT },
+	{ EV_SND, SND_MAX, UI_SET_SNDBIT },
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void sighandler(int signal)
+{
+	running = 0;
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until_us(uint64_t us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0 && running)
+		;
+}
+
+static int create_device(const struct rec_header *h)
+{
+	struct uinput_setup setup;
+	struct uinput_abs_setup abs;
+	unsigned int i;
+	int fd, type, code;
+
+	fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror("/dev/uinput");
+		return -1;
+	}
+
+	for (type = 1; type < EV_CNT; type++) {
+		/* force feedback needs effect uploads we can't replay */
+		if (!caps_test_bit(h->bits[0], type) || type == EV_FF)
+			continue;
+		ioctl(fd, UI_SET_EVBIT, type);
+	}
+
+	for (i = 0; i < sizeof(code_bits) / sizeof(code_bits[0]); i++) {
+		const uint8_t *bits = h->bits[code_bits[i].type];
+
+		if (!caps_test_bit(h->bits[0], code_bits[i].type))
+			continue;
+		for (code = 0; code <= code_bits[i].max; code++)
+			if (caps_test_bit(bits, code))
+				ioctl(fd, code_bits[i].request, code);
+	}
+
+	for (i = 0; i < INPUT_PROP_CNT; i++)
+		if (caps_test_bit(h->props, i))
+			ioctl(fd, UI_SET_PROPBIT, i);
+
+	for (code = 0; code < ABS_CNT; code++) {
+		if (!caps_test_bit(h->bits[EV_ABS], code))
+			continue;
+		memset(&abs, 0, sizeof(abs));
+		abs.code = code;
+		abs.absinfo = h->absinfo[code];
+		if (ioctl(fd, UI_ABS_SETUP, &abs) < 0)
+			perror("UI_ABS_SETUP");
+	}
+
+	memset(&setup, 0, sizeof(setup));
+	setup.id = h->id;
+	snprintf(setup.name, sizeof(setup.name), "%.*s",
+		 UINPUT_MAX_NAME_SIZE - 1, h->name[0] ? h->name : "Wacom replay");
+
+	if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 ||
+	    ioctl(fd, UI_DEV_CREATE) < 0) {
+		perror("uinput setup");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-f] [-l loops] [-d seconds] recording\n", name);
+	fprintf(stderr, "	-f	replay as fast as possible instead of at the recorded pace\n");
+	fprintf(stderr, "	-l	number of times to replay the recording (default 1)\n");
+	fprintf(stderr, "	-d	delay before the first event so clients can open the device (default 1)\n");
+}
+
+int main (int argc, char * argv[]) {
+
+	struct input_event events[REC_MAX_FRAME_EVENTS + 1];
+	struct rec_reader rec;
+	struct sigaction sa;
+	uint64_t start, base, first_us = 0, frame_us, late, max_late = 0;
+	unsigned long nframes = 0, nevents = 0, nlate = 0;
+	int fast = 0, loops = 1, delay = 1;
+	int fd, opt, loop, count = 0;
+	double elapsed;
+
+	while ((opt = getopt(argc, argv, "fl:d:h")) != -1) {
+		switch (opt) {
+			case 'f': fast = 1; break;
+			case 'l': loops = atoi(optarg); break;
+			case 'd': delay = atoi(optarg); break;
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	if (rec_reader_open(&rec, argv[optind]) < 0)
+		exit(1);
+
+	fd = create_device(rec.header);
+	if (fd < 0)
+		exit(1);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fprintf(stderr, "created '%s', replaying %llu frames %s\n",
+		rec.header->name,
+		(unsigned long long) rec.header->nframes,
+		fast ? "as fast as possible" : "in real time");
+	sleep(delay);
+
+	start = now_us();
+	for (loop = 0; running && loop < loops; loop++) {
+		rec_reader_seek(&rec, 0);
+		base = 0;
+
+		while (running &&
+		       (count = rec_reader_next(&rec, events, REC_MAX_FRAME_EVENTS + 1)) > 0) {
+			frame_us = rec_time_us(&events[0].time);
+
+			/* each loop is paced relative to its own first frame */
+			if (base == 0) {
+				first_us = frame_us;
+				base = now_us();
+			}
+
+			if (!fast) {
+				uint64_t target = base + (frame_us > first_us ? frame_us - first_us : 0);
+				uint64_t now = now_us();
+
+				if (now < target) {
+					sleep_until_us(target);
+				} else {
+					late = now - target;
+					if (late > 1000)
+						nlate++;
+					if (late > max_late)
+						max_late = late;
+				}
+			}
+
+			/* the kernel restamps the events, one write per frame */
+			if (write(fd, events, count * sizeof(struct input_event)) < 0) {
+				perror("write");
+				running = 0;
+				break;
+			}
+
+			nframes++;
+			nevents += count;
+		}
+
+		if (count < 0) {
+			fprintf(stderr, "%s: corrupt recording\n", argv[optind]);
+			break;
+		}
+	}
+
+	elapsed = (now_us() - start) / 1e6;
+	printf("%lu frames, %lu events in %.3f s (%.0f events/s)\n",
+		nframes, nevents, elapsed, elapsed > 0 ? nevents / elapsed : 0);
+	if (!fast)
+		printf("%lu frames more than 1 ms late, max %llu us\n",
+			nlate, (unsigned long long) max_late);
+
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+	rec_reader_close(&rec);
+	return 0;
+}
@@ -0,0 +1,159 @@
+/* Lock-free single-producer/single-consumer ring of event batches
+ *
+ * See event-ring.h. head and tail only ever grow; a slot index is the
+ * counter masked by the ring size. The producer publishes a slot with a
+ * release store of head, the consumer returns it with a release store
+ * of tail.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "event-ring.h"
+
+int event_ring_init(struct event_ring *ring, size_t depth)
+{
+	size_t size = 1;
+
+	while (size < depth)
+		size <<= 1;
+
+	memset(ring, 0, sizeof(*ring));
+
+	/* touch every slot now so the reader never page faults on them */
+	ring->slots = calloc(size, sizeof(struct event_batch));
+	if (!ring->slots) {
+		perror("calloc");
+		return -1;
+	}
+	memset(ring->slots, 0, size * sizeof(struct event_batch));
+	ring->mask = size - 1;
+
+	ring->efd = eventfd(0, EFD_CLOEXEC);
+	if (ring->efd < 0) {
+		perror("eventfd");
+		free(ring->slots);
+		return -1;
+	}
+
+	return 0;
+}
+
+void event_ring_free(struct event_ring *ring)
+{
+	close(ring->efd);
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+static void event_ring_wake(struct event_ring *ring)
+{
+	uint64_t one = 1;
+
+	/* pairs with the fence in event_ring_peek() */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_exchange_explicit(&ring->sleeping, 0, memory_order_relaxed))
+		if (write(ring->efd, &one, sizeof(one)) < 0)
+			perror("eventfd write");
+}
+
+struct event_batch *event_ring_reserve(struct event_ring *ring)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if (head - tail > ring->mask)
+		return NULL;
+
+	return &ring->slots[head & ring->mask];
+}
+
+void event_ring_commit(struct event_ring *ring)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	struct event_batch *batch = &ring->slots[head & ring->mask];
+
+	batch->lost = ring->pending_lost;
+	ring->pending_lost = 0;
+
+	if (head + 1 - tail > ring->high_water)
+		ring->high_water = head + 1 - tail;
+
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	event_ring_wake(ring);
+}
+
+void event_ring_overflow(struct event_ring *ring, int count)
+{
+	atomic_fetch_add_explicit(&ring->overflows, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&ring->lost, count, memory_order_relaxed);
+	ring->pending_lost += count;
+}
+
+int event_ring_push(struct event_ring *ring, int device,
+		    const struct input_event *events, int count)
+{
+	struct event_batch *batch = event_ring_reserve(ring);
+
+	if (!batch) {
+		event_ring_overflow(ring, count);
+		return -1;
+	}
+
+	batch->device = device;
+	batch->count = count;
+	memcpy(batch->events, events, count * sizeof(struct input_event));
+	event_ring_commit(ring);
+	return 0;
+}
+
+void event_ring_close(struct event_ring *ring)
+{
+	atomic_store_explicit(&ring->closed, 1, memory_order_release);
+	atomic_store_explicit(&ring->sleeping, 1, memory_order_relaxed);
+	event_ring_wake(ring);
+}
+
+struct event_batch *event_ring_peek(struct event_ring *ring)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint64_t count;
+
+	while (1) {
+		if (atomic_load_explicit(&ring->head, memory_order_acquire) != tail)
+			return &ring->slots[tail & ring->mask];
+		if (atomic_load_explicit(&ring->closed, memory_order_acquire))
+			return NULL;
+
+		/* announce that we sleep, then look again before we do so a
+		 * commit between the check above and the read isn't missed */
+		atomic_store_explicit(&ring->sleeping, 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (atomic_load_explicit(&ring->head, memory_order_acquire) != tail ||
+		    atomic_load_explicit(&ring->closed, memory_order_acquire)) {
+			atomic_store_explicit(&ring->sleeping, 0, memory_order_relaxed);
+			continue;
+		}
+
+		if (read(ring->efd, &count, sizeof(count)) < 0) {
+			atomic_store_explicit(&ring->sleeping, 0, memory_order_relaxed);
+			if (errno == EINTR)
+				return NULL;
+			perror("eventfd read");
+			return NULL;
+		}
+	}
+}
+
+void event_ring_release(struct event_ring *ring)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
@@ -0,0 +1,69 @@
+/* Lock-free single-producer/single-consumer ring of event batches
+ *
+ * Lets the evdev read loop run on its own thread while another thread
+ * formats or stores the events. The reader never waits for the
+ * consumer: if the ring is full the batch is dropped and counted, and
+ * the next batch that makes it into the ring carries the number of
+ * events lost before it. The consumer sleeps on an eventfd that the
+ * producer only signals when the consumer is actually waiting.
+ */
+
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <linux/input.h>
+
+#define EVENT_RING_BATCH	128
+#define EVENT_RING_DEPTH	256	/* default number of batches */
+
+struct event_batch {
+	int device;		/* producer defined source tag */
+	int count;
+	unsigned long lost;	/* events dropped right before this batch */
+	struct input_event events[EVENT_RING_BATCH];
+};
+
+struct event_ring {
+	/* written by the producer */
+	_Alignas(64) atomic_size_t head;
+	atomic_ulong overflows;	/* batches dropped because the ring was full */
+	atomic_ulong lost;	/* events in those batches */
+	unsigned long pending_lost;
+	size_t high_water;	/* most batches queued at once */
+	atomic_int closed;
+
+	/* written by the consumer */
+	_Alignas(64) atomic_size_t tail;
+	atomic_int sleeping;
+
+	_Alignas(64) struct event_batch *slots;
+	size_t mask;
+	int efd;
+};
+
+/* depth is rounded up to a power of two */
+int event_ring_init(struct event_ring *ring, size_t depth);
+void event_ring_free(struct event_ring *ring);
+
+/* Producer: get the next free slot, or NULL if the ring is full */
+struct event_batch *event_ring_reserve(struct event_ring *ring);
+/* Producer: publish the slot returned by event_ring_reserve() */
+void event_ring_commit(struct event_ring *ring);
+/* Producer: count a batch of count events that did not fit */
+void event_ring_overflow(struct event_ring *ring, int count);
+/* Producer: copy events into the ring, dropping them if it is full */
+int event_ring_push(struct event_ring *ring, int device,
+		    const struct input_event *events, int count);
+/* Producer: no more batches will follow */
+void event_ring_close(struct event_ring *ring);
+
+/* Consumer: wait for the next batch, NULL once the ring is closed and
+ * empty or when a signal interrupted the wait
+ */
+struct event_batch *event_ring_peek(struct event_ring *ring);
+/* Consumer: hand the batch from event_ring_peek() back to the producer */
+void event_ring_release(struct event_ring *ring);
+
+#endif /* EVENT_RING_H */
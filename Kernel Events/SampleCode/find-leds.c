@@ -5,87 +5,297 @@
  *
  * To run:
  *  ./find-leds
+ *
+ * Or keep running and print every mode switch as it happens, and the
+ * LEDs of tablets plugged in later:
+ *  ./find-leds -f
+ *
+ * Both status_led0_select and status_led1_select (the second mode
+ * switch of the larger Intuos and Cintiq models) are opened once and
+ * kept open. The driver calls sysfs_notify() when a mode changes,
+ * which makes poll() report POLLPRI on the attribute; the new value
+ * is then read with pread() at offset 0 from the same descriptor.
+ *
+ * New tablets are found through kernel uevents: sysfs doesn't report
+ * a driver binding a device through inotify, so watching
+ * /sys/bus/hid/drivers/wacom with inotify would miss them. A hid
+ * uevent only adds or drops the device it names, so the devices found
+ * earlier, with or without LEDs, are not reported again.
  */
 
-#include <dirent.h> 
-#include <stdio.h> 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#define WACOM_DRIVER	"/sys/bus/hid/drivers/wacom"
+#define MAX_DEVICES	16
+#define NLEDS		2
+
+struct led_device {
+	char name[64];		/* entry in WACOM_DRIVER, e.g. 0003:056A:00B9.0001 */
+	int fd[NLEDS];		/* status_ledN_select, -1 if missing or no leds */
+	char value[NLEDS][16];
+};
 
-/* Concatenate on the end of a path */
-int add_to_path(char * buf, char *root, char* adding){
-	strcpy(buf, root);
-	strcat(buf, "/");
-	strcat(buf, adding);
+static struct led_device devices[MAX_DEVICES];
+static int ndevices;
+
+/* Read an attribute again from the start, without reopening it */
+static int read_value(int fd, char *buf, size_t size)
+{
+	ssize_t n = pread(fd, buf, size - 1, 0);
+
+	if (n < 0)
+		return -1;
+
+	buf[n] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
 }
 
-/* find the mode on a device that has an led */
-int find_mode(char *path){
-	FILE *f;
-	struct dirent *dir;
-        char str[1024];
-	char c;
-
-	/* Note: a few devices also conain a second led switch 
-	 * at "status_led1_select" that we don't look for
-	 * here for the sake of simplicity.
-	 */
-	add_to_path(str, path, "status_led0_select");
-
-	f = fopen(str,"r");
-	if (f) {
-		fscanf(f,"%c", &c);
-		printf("%s - value of mode switch=%c\n", str, c);
-
-	} else {
-		printf("no led file found - %s\n", str);
-	}
+static void remove_device(struct led_device *dev)
+{
+	int i;
+
+	printf("%s/%s - removed\n", WACOM_DRIVER, dev->name);
+	for (i = 0; i < NLEDS; i++)
+		if (dev->fd[i] >= 0)
+			close(dev->fd[i]);
+
+	*dev = devices[--ndevices];
 }
 
 /* See if we have a device with leds */
-void find_led_dev(char *path) {
+static void add_device(const char *name)
+{
+	struct led_device *dev;
+	char path[512];
+	int i, found = 0;
 
-	DIR *d;
-	struct dirent *dir;
-	char str[1024];
-
-	d = opendir(path);
-	if (d) {
-		while ((dir = readdir(d)) != NULL) {
-			if(strcmp(dir->d_name, "wacom_led") == 0) {
-				add_to_path(str, path, "wacom_led");
-				find_mode(str);
-				return;
-			}
+	for (i = 0; i < ndevices; i++)
+		if (strcmp(devices[i].name, name) == 0)
+			return;
+
+	if (ndevices == MAX_DEVICES) {
+		fprintf(stderr, "%s: too many devices\n", name);
+		return;
+	}
+
+	dev = &devices[ndevices];
+	snprintf(dev->name, sizeof(dev->name), "%s", name);
+
+	for (i = 0; i < NLEDS; i++) {
+		snprintf(path, sizeof(path), "%s/%s/wacom_led/status_led%d_select",
+			 WACOM_DRIVER, name, i);
+
+		dev->fd[i] = open(path, O_RDONLY | O_CLOEXEC);
+		if (dev->fd[i] < 0)
+			continue;
+
+		if (read_value(dev->fd[i], dev->value[i], sizeof(dev->value[i])) < 0) {
+			close(dev->fd[i]);
+			dev->fd[i] = -1;
+			continue;
 		}
-		printf("%s - no devices with leds\n", path);
 
-		closedir(d);
-  	}
-}
+		printf("%s - value of mode switch=%s\n", path, dev->value[i]);
+		found++;
+	}
 
-/* Call finddev if the wacom sysfs diretory contains a device */
-int main(void) {
+	/* kept anyway, so it is reported only once */
+	if (!found)
+		printf("%s/%s - no devices with leds\n", WACOM_DRIVER, name);
 
+	ndevices++;
+}
+
+/* Call add_device for every device the wacom driver is bound to */
+static void scan(void)
+{
 	DIR *d;
 	struct dirent *dir;
-	char str[1024];
-	char *start = "/sys/bus/hid/drivers/wacom";
-	d = opendir(start);
 
-	if (d) {
-		while ((dir = readdir(d)) != NULL) {
+	d = opendir(WACOM_DRIVER);
+	if (!d)
+		return;
+
+	while ((dir = readdir(d)) != NULL) {
 		/* if the wacom driver directory contains entries that
 		 * starts with "0" we know that there is a device to
 		 * examine further
 		 */
-			if (dir->d_name[0] == '0') {
-				add_to_path(str, start, dir->d_name);
-				find_led_dev(str);
+		if (dir->d_name[0] == '0')
+			add_device(dir->d_name);
+	}
+
+	closedir(d);
+}
+
+static int open_uevent_socket(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* kernel uevents, not the udev ones */
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Add or drop the hid device at the end of devpath */
+static void handle_uevent(const char *action, const char *devpath)
+{
+	const char *name = strrchr(devpath, '/');
+	char path[512];
+	int i;
+
+	if (!name)
+		return;
+	name++;
+
+	/* "add" comes before the driver is bound, "bind" after */
+	if (strcmp(action, "add") == 0 || strcmp(action, "bind") == 0) {
+		snprintf(path, sizeof(path), "%s/%s", WACOM_DRIVER, name);
+		if (access(path, F_OK) == 0)
+			add_device(name);
+	} else if (strcmp(action, "remove") == 0 || strcmp(action, "unbind") == 0) {
+		for (i = 0; i < ndevices; i++) {
+			if (strcmp(devices[i].name, name) == 0) {
+				remove_device(&devices[i]);
+				break;
 			}
 		}
+	}
+}
+
+static void read_uevents(int fd)
+{
+	char buf[4096];
+	const char *action, *devpath;
+	ssize_t len, i;
+	int hid;
+
+	while ((len = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = '\0';
+		action = devpath = NULL;
+		hid = 0;
+
+		/* "ACTION@DEVPATH" followed by NUL separated KEY=value */
+		for (i = 0; i < len; i += strlen(buf + i) + 1) {
+			if (strncmp(buf + i, "ACTION=", 7) == 0)
+				action = buf + i + 7;
+			else if (strncmp(buf + i, "DEVPATH=", 8) == 0)
+				devpath = buf + i + 8;
+			else if (strcmp(buf + i, "SUBSYSTEM=hid") == 0)
+				hid = 1;
+		}
 
-		closedir(d);
+		if (hid && action && devpath)
+			handle_uevent(action, devpath);
 	}
+}
+
+static void follow(void)
+{
+	struct pollfd fds[1 + MAX_DEVICES * NLEDS];
+	struct led_device *owner[1 + MAX_DEVICES * NLEDS];
+	int led[1 + MAX_DEVICES * NLEDS];
+	char value[16];
+	int uevent_fd, nfds, i, j;
+
+	uevent_fd = open_uevent_socket();
+	if (uevent_fd < 0)
+		perror("uevent socket, not following new devices");
+
+	while (1) {
+		/* rebuilt only after a device came or went */
+		nfds = 0;
+		fds[nfds].fd = uevent_fd;
+		fds[nfds].events = POLLIN;
+		nfds++;
+
+		for (i = 0; i < ndevices; i++) {
+			for (j = 0; j < NLEDS; j++) {
+				if (devices[i].fd[j] < 0)
+					continue;
+				fds[nfds].fd = devices[i].fd[j];
+				fds[nfds].events = POLLPRI | POLLERR;
+				owner[nfds] = &devices[i];
+				led[nfds] = j;
+				nfds++;
+			}
+		}
+
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			return;
+		}
+
+		for (i = nfds - 1; i > 0; i--) {
+			struct led_device *dev = owner[i];
+
+			if (!fds[i].revents)
+				continue;
+
+			/* a removed attribute fails to read */
+			if (read_value(fds[i].fd, value, sizeof(value)) < 0) {
+				remove_device(dev);
+				break;
+			}
+
+			if (strcmp(value, dev->value[led[i]]) == 0)
+				continue;
+
+			snprintf(dev->value[led[i]], sizeof(dev->value[led[i]]), "%s", value);
+			printf("%s/%s/wacom_led/status_led%d_select - value of mode switch=%s\n",
+			       WACOM_DRIVER, dev->name, led[i], value);
+			fflush(stdout);
+		}
+
+		if (fds[0].revents & POLLIN) {
+			read_uevents(uevent_fd);
+			fflush(stdout);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, keep_running = 0;
+
+	while ((opt = getopt(argc, argv, "fh")) != -1) {
+		if (opt == 'f') {
+			keep_running = 1;
+		} else {
+			fprintf(stderr, "Usage: %s [-f]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	scan();
+	fflush(stdout);
+
+	if (keep_running)
+		follow();
 
 	return(0);
 }
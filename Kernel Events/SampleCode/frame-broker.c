@@ -0,0 +1,200 @@
+/* Read every tablet once and share its pen frames with other processes
+ *
+ * to compile:
+ *  gcc -o frame-broker frame-broker.c frame-bus.c capture.c pen-frame.c -lpthread
+ *  gcc -o frame-client frame-client.c frame-bus.c pen-frame.c
+ *
+ * to run:
+ *  publish the frames of every Wacom node:
+ *  sudo ./frame-broker
+ *
+ *  or of some nodes, grabbed so nobody else gets their events:
+ *  sudo ./frame-broker -g /dev/input/eventX /dev/input/eventY
+ *
+ *  then start as many clients as needed, as the user that ran sudo:
+ *  ./frame-client
+ *
+ *  the socket is only open to that user (or root without sudo), give
+ *  it to somebody else with:
+ *  sudo ./frame-broker -u user
+ *
+ * The broker assembles each node's events into pen frames (see
+ * pen-frame.h) and writes them into a shared memory ring (see
+ * frame-bus.h). A client connects to the Unix socket, gets the memfd of
+ * the ring passed over it and from then on reads frames straight out
+ * of shared memory; the socket is only used for that handshake. The
+ * ring is passed read-only, clients can't change what the others read.
+ * A slow client never holds up the broker or the other clients, it
+ * notices it was lapped and counts the frames it missed.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/input.h>
+
+#include "capture.h"
+#include "pen-frame.h"
+#include "frame-bus.h"
+
+struct broker {
+	struct frame_bus bus;
+	struct pen_assembler pens[CAPTURE_MAX_DEVICES];
+	int listen_fd;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void sighandler(int signal)
+{
+	running = 0;
+}
+
+static void publish_frames(struct capture_device *dev,
+			   const struct input_event *events, int count,
+			   void *data)
+{
+	struct broker *b = data;
+	struct pen_frame frame;
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (pen_assembler_feed(&b->pens[dev->index], &events[i], &frame))
+			frame_bus_publish(&b->bus, dev->index, &frame);
+}
+
+/* Hand the memfd to every client that connects */
+static void *accept_thread(void *data)
+{
+	struct broker *b = data;
+	int client;
+
+	while ((client = accept4(b->listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+		if (frame_bus_send(client, &b->bus) < 0)
+			perror("sendmsg");
+		close(client);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct broker b;
+	struct capture cap;
+	struct sigaction sa;
+	sigset_t sigs, oldsigs;
+	pthread_t acceptor;
+	const char *path = FRAME_BUS_SOCKET;
+	const char *user = NULL, *sudo_uid;
+	struct passwd *pw;
+	uid_t owner = -1;
+	int grab = 0;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "gs:u:h")) != -1) {
+		switch (opt) {
+			case 'g': grab = 1; break;
+			case 's': path = optarg; break;
+			case 'u': user = optarg; break;
+			default:
+				fprintf(stderr, "Usage: %s [-g] [-s socket] [-u user] [/dev/input/eventX ...]\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	/* who may connect: -u, or whoever ran sudo */
+	if (user) {
+		pw = getpwnam(user);
+		if (!pw) {
+			fprintf(stderr, "%s: no such user\n", user);
+			exit(1);
+		}
+		owner = pw->pw_uid;
+	} else if ((sudo_uid = getenv("SUDO_UID"))) {
+		owner = strtoul(sudo_uid, NULL, 10);
+	}
+
+	/* no SA_RESTART, so a signal interrupts epoll_wait */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if (capture_init(&cap) < 0)
+		exit(1);
+
+	if (optind < argc) {
+		for (i = optind; i < argc; i++)
+			if (!capture_add_device(&cap, argv[i]))
+				exit(1);
+	} else if (capture_add_wacom_devices(&cap) == 0) {
+		fprintf(stderr, "no Wacom devices found\n");
+		exit(1);
+	}
+
+	if (frame_bus_create(&b.bus, FRAME_BUS_SLOTS) < 0)
+		exit(1);
+
+	b.bus.shm->ndevices = cap.ndevices;
+	for (i = 0; i < cap.ndevices; i++) {
+		struct capture_device *dev = &cap.devices[i];
+
+		if (grab && ioctl(dev->fd, EVIOCGRAB, 1) < 0)
+			perror("EVIOCGRAB");
+
+		pen_assembler_init(&b.pens[i], dev->fd);
+		pen_assembler_resync(&b.pens[i]);
+
+		snprintf(b.bus.shm->devices[i], sizeof(b.bus.shm->devices[i]),
+			 "%.40s: %.80s", dev->path, dev->name);
+		fprintf(stderr, "%s\n", b.bus.shm->devices[i]);
+	}
+
+	b.listen_fd = frame_bus_listen(path, owner);
+	if (b.listen_fd < 0)
+		exit(1);
+
+	/* signals go to this thread */
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+	if (pthread_create(&acceptor, NULL, accept_thread, &b) != 0) {
+		fprintf(stderr, "failed to start the accept thread\n");
+		exit(1);
+	}
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+	fprintf(stderr, "publishing on %s\n", path);
+
+	while (running && cap.nopen > 0) {
+		if (capture_dispatch(&cap, -1, publish_frames, &b) < 0) {
+			perror("epoll_wait");
+			break;
+		}
+		capture_report_removed(&cap);
+	}
+
+	fprintf(stderr, "%llu frames published\n",
+		(unsigned long long) atomic_load(&b.bus.shm->head));
+
+	/* wakes the accept thread with EINVAL */
+	shutdown(b.listen_fd, SHUT_RDWR);
+	pthread_join(acceptor, NULL);
+	close(b.listen_fd);
+	unlink(path);
+
+	/* clients keep their mapping, they just see no more frames */
+	frame_bus_close(&b.bus);
+	capture_close(&cap);
+	return 0;
+}
@@ -0,0 +1,382 @@
+/* Shared memory ring of pen frames, one writer, any number of readers
+ *
+ * See frame-bus.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+
+#include "frame-bus.h"
+
+static size_t page_size(void)
+{
+	return sysconf(_SC_PAGESIZE);
+}
+
+/* not FUTEX_PRIVATE_FLAG, the word is shared between processes */
+static int futex(atomic_uint *word, int op, unsigned int val,
+		 const struct timespec *timeout)
+{
+	return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
+
+static int frame_bus_map(struct frame_bus *bus, int shm_prot)
+{
+	bus->readers = mmap(NULL, page_size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+			    bus->readers_fd, 0);
+	if (bus->readers == MAP_FAILED) {
+		bus->readers = NULL;
+		perror("mmap");
+		return -1;
+	}
+
+	bus->shm = mmap(NULL, bus->size, shm_prot, MAP_SHARED, bus->fd, 0);
+	if (bus->shm == MAP_FAILED) {
+		bus->shm = NULL;
+		perror("mmap");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* clients can rely on the size never changing under their mapping */
+static int create_memfd(const char *name, size_t size)
+{
+	int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+	if (fd < 0) {
+		perror("memfd_create");
+		return -1;
+	}
+
+	if (ftruncate(fd, size) < 0 ||
+	    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+		perror("memfd");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int frame_bus_create(struct frame_bus *bus, uint32_t nslots)
+{
+	size_t page = page_size();
+	char path[64];
+
+	memset(bus, 0, sizeof(*bus));
+	bus->fd = bus->ro_fd = bus->readers_fd = -1;
+
+	if (nslots == 0 || (nslots & (nslots - 1))) {
+		fprintf(stderr, "frame bus: %u slots, need a power of two\n", nslots);
+		return -1;
+	}
+
+	bus->size = sizeof(struct frame_bus_shm) +
+		    nslots * sizeof(struct frame_bus_slot);
+	bus->size = (bus->size + page - 1) / page * page;
+	bus->nslots = nslots;
+
+	bus->fd = create_memfd("wacom-frames", bus->size);
+	bus->readers_fd = create_memfd("wacom-frames-readers", page);
+	if (bus->fd < 0 || bus->readers_fd < 0) {
+		frame_bus_close(bus);
+		return -1;
+	}
+
+	/* a new open file description without write access, mmap() refuses
+	 * PROT_WRITE on it, whatever the client asks for */
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", bus->fd);
+	bus->ro_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (bus->ro_fd < 0) {
+		perror(path);
+		frame_bus_close(bus);
+		return -1;
+	}
+
+	if (frame_bus_map(bus, PROT_READ | PROT_WRITE) < 0) {
+		frame_bus_close(bus);
+		return -1;
+	}
+
+	/* the memfd starts out zeroed, slots with seq 0 hold no frame */
+	memcpy(bus->shm->magic, FRAME_BUS_MAGIC, 8);
+	bus->shm->nslots = nslots;
+	return 0;
+}
+
+int frame_bus_attach(struct frame_bus *bus, int fd, int readers_fd)
+{
+	struct stat st, rst;
+	uint32_t nslots;
+
+	memset(bus, 0, sizeof(*bus));
+	bus->fd = fd;
+	bus->ro_fd = -1;
+	bus->readers_fd = readers_fd;
+
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(struct frame_bus_shm) ||
+	    fstat(readers_fd, &rst) < 0 || (size_t) rst.st_size < page_size()) {
+		fprintf(stderr, "frame bus: bad memfd\n");
+		frame_bus_close(bus);
+		return -1;
+	}
+	bus->size = st.st_size;
+
+	if (frame_bus_map(bus, PROT_READ) < 0) {
+		frame_bus_close(bus);
+		return -1;
+	}
+
+	/* from here on only the copy that was checked is used */
+	nslots = bus->shm->nslots;
+	if (memcmp(bus->shm->magic, FRAME_BUS_MAGIC, 8) != 0 ||
+	    nslots == 0 || (nslots & (nslots - 1)) ||
+	    sizeof(struct frame_bus_shm) +
+	    (size_t) nslots * sizeof(struct frame_bus_slot) > bus->size) {
+		fprintf(stderr, "frame bus: not a frame bus\n");
+		frame_bus_close(bus);
+		return -1;
+	}
+	bus->nslots = nslots;
+
+	/* start with the next frame published, not the backlog */
+	bus->next = atomic_load_explicit(&bus->shm->head, memory_order_acquire);
+	return 0;
+}
+
+void frame_bus_close(struct frame_bus *bus)
+{
+	if (bus->shm)
+		munmap(bus->shm, bus->size);
+	if (bus->readers)
+		munmap(bus->readers, page_size());
+	if (bus->fd >= 0)
+		close(bus->fd);
+	if (bus->ro_fd >= 0)
+		close(bus->ro_fd);
+	if (bus->readers_fd >= 0)
+		close(bus->readers_fd);
+
+	bus->shm = NULL;
+	bus->readers = NULL;
+	bus->fd = bus->ro_fd = bus->readers_fd = -1;
+}
+
+void frame_bus_publish(struct frame_bus *bus, int device,
+		       const struct pen_frame *frame)
+{
+	struct frame_bus_shm *shm = bus->shm;
+	uint64_t n = atomic_load_explicit(&shm->head, memory_order_relaxed);
+	struct frame_bus_slot *slot = &shm->slots[n & (bus->nslots - 1)];
+
+	/* odd: readers that copy the slot now will see the change */
+	atomic_store_explicit(&slot->seq, 2 * n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->device = device;
+	slot->frame = *frame;
+
+	atomic_store_explicit(&slot->seq, 2 * n + 2, memory_order_release);
+	atomic_store_explicit(&shm->head, n + 1, memory_order_release);
+
+	/* pairs with the sleepers increment and wake load in the reader */
+	atomic_fetch_add(&bus->readers->wake, 1);
+	if (atomic_load(&bus->readers->sleepers) > 0)
+		futex(&bus->readers->wake, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+static int frame_bus_wait(struct frame_bus *bus, int timeout)
+{
+	struct frame_bus_readers *readers = bus->readers;
+	struct timespec ts;
+	unsigned int wake;
+	int ret = 0;
+
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000L;
+
+	wake = atomic_load(&readers->wake);
+	atomic_fetch_add(&readers->sleepers, 1);
+
+	/* a frame published after the wake load changes the futex word,
+	 * so FUTEX_WAIT returns at once instead of missing it */
+	if (atomic_load(&bus->shm->head) == bus->next &&
+	    futex(&readers->wake, FUTEX_WAIT, wake, timeout < 0 ? NULL : &ts) < 0 &&
+	    errno != EAGAIN)
+		ret = -1;
+
+	atomic_fetch_sub(&readers->sleepers, 1);
+	return ret;
+}
+
+int frame_bus_read(struct frame_bus *bus, int *device, struct pen_frame *frame,
+		   int timeout)
+{
+	struct frame_bus_shm *shm = bus->shm;
+	struct frame_bus_slot *slot;
+	uint64_t head, seq;
+
+	while (1) {
+		head = atomic_load_explicit(&shm->head, memory_order_acquire);
+		if (bus->next == head) {
+			if (timeout == 0 || frame_bus_wait(bus, timeout) < 0)
+				return 0;	/* timed out or interrupted */
+			continue;
+		}
+
+		/* lapped: only the last nslots frames are still there */
+		if (head - bus->next > bus->nslots) {
+			bus->lost += head - bus->nslots - bus->next;
+			bus->next = head - bus->nslots;
+		}
+
+		slot = &shm->slots[bus->next & (bus->nslots - 1)];
+		seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+		*device = slot->device;
+		*frame = slot->frame;
+
+		atomic_thread_fence(memory_order_acquire);
+		if (seq == 2 * bus->next + 2 &&
+		    atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+			bus->next++;
+			return 1;
+		}
+
+		/* overwritten before or while we copied it */
+		bus->lost++;
+		bus->next++;
+	}
+}
+
+int frame_bus_listen(const char *path, uid_t owner)
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd, rc;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	/* the socket file is 0600 from the start, not after a chmod */
+	unlink(path);
+	mask = umask(077);
+	rc = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+
+	/* lchown, with -s path could be in a shared directory and a symlink by now */
+	if (rc < 0 || (owner != (uid_t) -1 && lchown(path, owner, -1) < 0) ||
+	    listen(fd, 8) < 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int frame_bus_send(int client, const struct frame_bus *bus)
+{
+	char cbuf[CMSG_SPACE(2 * sizeof(int))];
+	int fds[2] = { bus->ro_fd, bus->readers_fd };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	uint32_t nslots = bus->nslots;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	iov.iov_base = &nslots;
+	iov.iov_len = sizeof(nslots);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	return sendmsg(client, &msg, MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+int frame_bus_connect(const char *path, struct frame_bus *bus)
+{
+	char cbuf[CMSG_SPACE(2 * sizeof(int))];
+	struct sockaddr_un addr;
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	uint32_t nslots;
+	int sock, fds[2] = { -1, -1 };
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0 || connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror(path);
+		if (sock >= 0)
+			close(sock);
+		return -1;
+	}
+
+	/* anybody could have bound a socket given with -s, only trust root */
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ||
+	    cred.uid != 0) {
+		fprintf(stderr, "%s: broker is not running as root\n", path);
+		close(sock);
+		return -1;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &nslots;
+	iov.iov_len = sizeof(nslots);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) == sizeof(nslots)) {
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_RIGHTS &&
+		    cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	}
+	close(sock);
+
+	if (fds[0] < 0 || fds[1] < 0) {
+		fprintf(stderr, "%s: no frame bus received\n", path);
+		return -1;
+	}
+
+	return frame_bus_attach(bus, fds[0], fds[1]);
+}
@@ -0,0 +1,101 @@
+/* Shared memory ring of pen frames, one writer, any number of readers
+ *
+ * The broker (frame-broker.c) reads every tablet once and publishes
+ * assembled pen frames into a memfd. Clients get the memfd over a Unix
+ * socket, reopened read-only so they can't map it for writing, and
+ * every frame is copied once into shared memory and read from there by
+ * all of them. The socket belongs to one user and is closed to
+ * everybody else. It lives in /run, where only root can create it, and
+ * clients only take the memfd from a broker running as root.
+ *
+ * Frame n goes to slot n % nslots. The slot's sequence number is odd
+ * while the writer fills it in and 2n + 2 once frame n is complete. A
+ * reader copies the frame and checks the sequence number before and
+ * after: if it changed, or doesn't match the frame the reader expected,
+ * the writer has lapped the reader and the frames in between are
+ * counted as lost. The writer never waits for readers.
+ *
+ * Readers that run out of frames sleep on a futex. The futex word and
+ * the count of sleepers live in a second, one page memfd that clients
+ * map writable, so the writer only makes the wake up system call when
+ * somebody is sleeping. A client scribbling over that page can cause
+ * missed or spurious wake ups, never wrong frames.
+ */
+
+#ifndef FRAME_BUS_H
+#define FRAME_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "pen-frame.h"
+
+#define FRAME_BUS_MAGIC		"WACOMBUS"
+#define FRAME_BUS_SLOTS		4096
+#define FRAME_BUS_MAX_DEVICES	64
+#define FRAME_BUS_SOCKET	"/run/wacom-frames.sock"
+
+struct frame_bus_slot {
+	atomic_uint_fast64_t seq;
+	int32_t device;
+	struct pen_frame frame;
+};
+
+/* the readers memfd, writable by everybody */
+struct frame_bus_readers {
+	atomic_uint sleepers;
+	atomic_uint wake;				/* futex word */
+};
+
+/* the ring memfd, written by the broker only */
+struct frame_bus_shm {
+	char magic[8];
+	uint32_t nslots;
+	uint32_t ndevices;
+	char devices[FRAME_BUS_MAX_DEVICES][128];	/* "path: name" */
+	_Alignas(64) atomic_uint_fast64_t head;		/* frames published */
+	_Alignas(64) struct frame_bus_slot slots[];
+};
+
+struct frame_bus {
+	int fd;			/* the ring, read-only for readers */
+	int ro_fd;		/* writer: the ring reopened read-only */
+	int readers_fd;
+	size_t size;		/* of the ring */
+	uint32_t nslots;	/* checked once, not read from the ring again */
+	struct frame_bus_readers *readers;
+	struct frame_bus_shm *shm;
+
+	/* reader side */
+	uint64_t next;		/* next frame to read */
+	unsigned long lost;	/* frames overwritten before we got to them */
+};
+
+/* Writer: create the memfd with nslots (a power of two) slots */
+int frame_bus_create(struct frame_bus *bus, uint32_t nslots);
+
+/* Reader: map the memfds received from the broker */
+int frame_bus_attach(struct frame_bus *bus, int fd, int readers_fd);
+
+void frame_bus_close(struct frame_bus *bus);
+
+void frame_bus_publish(struct frame_bus *bus, int device,
+		       const struct pen_frame *frame);
+
+/* Copy the next frame, waiting up to timeout ms (-1: forever).
+ * Returns 1 for a frame, 0 on timeout or signal.
+ */
+int frame_bus_read(struct frame_bus *bus, int *device, struct pen_frame *frame,
+		   int timeout);
+
+/* Unix socket handshake: the broker sends the memfds to every client
+ * that connects to path and hangs up. The socket is created mode 0600
+ * and given to owner, unless that is -1. A client only accepts the
+ * memfds if the process at the other end runs as root. */
+int frame_bus_listen(const char *path, uid_t owner);
+int frame_bus_send(int client, const struct frame_bus *bus);
+int frame_bus_connect(const char *path, struct frame_bus *bus);
+
+#endif /* FRAME_BUS_H */
@@ -0,0 +1,90 @@
+/* Print the pen frames published by frame-broker.c
+ *
+ * to compile:
+ *  gcc -o frame-client frame-client.c frame-bus.c pen-frame.c
+ *
+ * to run:
+ *  start frame-broker first, then:
+ *  ./frame-client
+ *
+ *  pretend to be a slow consumer, taking N microseconds per frame, to
+ *  see the broker lap it:
+ *  ./frame-client -d N
+ *
+ * Every client sees every frame as long as it keeps up; frames it
+ * missed are reported instead of slowing down anybody else.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "frame-bus.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void sighandler(int signal)
+{
+	running = 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct frame_bus bus;
+	struct pen_frame frame;
+	struct sigaction sa;
+	const char *path = FRAME_BUS_SOCKET;
+	unsigned long reported = 0, nframes = 0;
+	int delay = 0;
+	int device, i, opt;
+
+	while ((opt = getopt(argc, argv, "s:d:h")) != -1) {
+		switch (opt) {
+			case 's': path = optarg; break;
+			case 'd': delay = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: %s [-s socket] [-d delay-us]\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if (frame_bus_connect(path, &bus) < 0)
+		exit(1);
+
+	for (i = 0; i < (int) bus.shm->ndevices && i < FRAME_BUS_MAX_DEVICES; i++)
+		fprintf(stderr, "%d: %.*s\n", i, (int) sizeof(bus.shm->devices[i]),
+			bus.shm->devices[i]);
+
+	while (running) {
+		if (!frame_bus_read(&bus, &device, &frame, 1000))
+			continue;
+
+		if (bus.lost != reported) {
+			printf("%lu frames lost, too slow\n", bus.lost - reported);
+			reported = bus.lost;
+		}
+
+		nframes++;
+		if (frame.changed & (PEN_CHANGED_X | PEN_CHANGED_Y | PEN_CHANGED_PRESSURE))
+			printf("%d: %-6s x value %6d\ty value %6d\tpressure value %4d\n",
+				device,
+				pen_tool_name(frame.tool),
+				frame.x,
+				frame.y,
+				frame.pressure);
+
+		if (delay)
+			usleep(delay);
+	}
+
+	fprintf(stderr, "%lu frames, %lu lost\n", nframes, bus.lost);
+	frame_bus_close(&bus);
+	return 0;
+}
@@ -0,0 +1,163 @@
+/* Check the hidraw pen decoder against dumps with known frames
+ *
+ * to compile:
+ *  gcc -o hid-pen-test hid-pen-test.c hid-pen.c pen-frame.c
+ *
+ * to run:
+ *  ./hid-pen-test testdata/intuos-pen.dump testdata/intuos-pen.frames \
+ *                 testdata/cintiq-pen.dump testdata/cintiq-pen.frames
+ *
+ *  write the frames file of a new dump, made with hidraw-pen -w, after
+ *  checking the decoded frames by hand:
+ *  ./hid-pen-test -g pen.dump > pen.frames
+ *
+ * Every dump is parsed with hid_pen_parse() and its reports decoded
+ * with hid_pen_decode(). Each pen frame is printed as one line and
+ * compared with the next line of the frames file; lines starting with
+ * '#' are comments. The exit status is 1 if any frame differs, or if
+ * either side has frames the other doesn't.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hid-pen.h"
+#include "pen-frame.h"
+
+#define MAX_REPORT	1024
+
+static void format_frame(char *buf, size_t len, const struct pen_frame *f)
+{
+	snprintf(buf, len, "%llu %s %d %d %d %d %d %d %d %d %u 0x%x 0x%x",
+		 (unsigned long long) f->time.tv_sec * 1000000 + f->time.tv_usec,
+		 pen_tool_name(f->tool), f->x, f->y, f->pressure,
+		 f->tilt_x, f->tilt_y, f->distance, f->wheel, f->tool_id,
+		 f->serial, f->buttons, f->changed);
+}
+
+/* Next line of the frames file without its newline, NULL at the end */
+static char *next_expected(FILE *f, char *buf, size_t len)
+{
+	while (fgets(buf, len, f)) {
+		buf[strcspn(buf, "\n")] = '\0';
+		if (buf[0] != '#' && buf[0] != '\0')
+			return buf;
+	}
+
+	return NULL;
+}
+
+/* Returns the number of mismatches, -1 if a file can't be read */
+static int check_dump(const char *dump, const char *frames)
+{
+	static struct hid_pen_dump_header hdr;
+	struct hid_pen_dump_record rec;
+	struct hid_pen hp;
+	struct pen_frame frame;
+	struct timeval tv;
+	uint8_t report[MAX_REPORT];
+	char got[256], line[256], *want;
+	unsigned long nframes = 0;
+	FILE *in, *expected = NULL;
+	int errors = 0;
+
+	in = fopen(dump, "rb");
+	if (!in) {
+		perror(dump);
+		return -1;
+	}
+
+	if (frames && !(expected = fopen(frames, "r"))) {
+		perror(frames);
+		fclose(in);
+		return -1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+	    memcmp(hdr.magic, HID_PEN_DUMP_MAGIC, 8) != 0 ||
+	    hdr.desc_size > HID_MAX_DESCRIPTOR_SIZE ||
+	    hid_pen_parse(&hp, hdr.desc, hdr.desc_size) <= 0) {
+		fprintf(stderr, "%s: not a hidraw dump with pen reports\n", dump);
+		errors = -1;
+		goto out;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, in) == 1) {
+		if (rec.size > sizeof(report) || fread(report, rec.size, 1, in) != 1) {
+			fprintf(stderr, "%s: truncated\n", dump);
+			errors++;
+			break;
+		}
+
+		tv.tv_sec = rec.time_us / 1000000;
+		tv.tv_usec = rec.time_us % 1000000;
+		if (!hid_pen_decode(&hp, report, rec.size, &tv, &frame))
+			continue;
+
+		nframes++;
+		format_frame(got, sizeof(got), &frame);
+		if (!expected) {
+			printf("%s\n", got);
+			continue;
+		}
+
+		want = next_expected(expected, line, sizeof(line));
+		if (!want || strcmp(got, want) != 0) {
+			fprintf(stderr, "%s: frame %lu\n  expected: %s\n  decoded:  %s\n",
+				dump, nframes, want ? want : "(no more frames)", got);
+			errors++;
+		}
+	}
+
+	while (expected && next_expected(expected, line, sizeof(line))) {
+		fprintf(stderr, "%s: expected frame not decoded: %s\n", dump, line);
+		errors++;
+	}
+
+	if (expected)
+		fprintf(stderr, "%s: %d fields, %lu frames, %s\n", dump, hp.nfields,
+			nframes, errors ? "FAILED" : "ok");
+
+out:
+	if (expected)
+		fclose(expected);
+	fclose(in);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	int generate = 0, failed = 0;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "gh")) != -1) {
+		switch (opt) {
+			case 'g': generate = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s dump frames [dump frames ...]\n", argv[0]);
+				fprintf(stderr, "       %s -g dump\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	if (generate) {
+		if (optind + 1 != argc) {
+			fprintf(stderr, "Usage: %s -g dump\n", argv[0]);
+			exit(1);
+		}
+		return check_dump(argv[optind], NULL) != 0;
+	}
+
+	if (optind == argc || (argc - optind) % 2) {
+		fprintf(stderr, "Usage: %s dump frames [dump frames ...]\n", argv[0]);
+		exit(1);
+	}
+
+	for (i = optind; i < argc; i += 2)
+		if (check_dump(argv[i], argv[i + 1]) != 0)
+			failed = 1;
+
+	return failed;
+}
@@ -0,0 +1,354 @@
+/* Table driven pen report decoder for hidraw
+ *
+ * See hid-pen.h. Item layout and tags are from the HID 1.11
+ * specification, section 6.2.2, usages from the HID Usage Tables
+ * (Generic Desktop 0x01, Digitizers 0x0D).
+ */
+
+#include <string.h>
+#include <linux/input.h>
+
+#include "hid-pen.h"
+
+#define PAGE_DIGITIZER		0x000d
+#define PAGE_WACOM		0xff0d	/* Wacom copy of the digitizer page */
+
+#define USAGE_DIGITIZER		0x000d0001
+#define USAGE_PEN		0x000d0002
+
+/* item tags, (tag << 4) | (type << 2) */
+#define ITEM_INPUT		0x80
+#define ITEM_OUTPUT		0x90
+#define ITEM_COLLECTION		0xa0
+#define ITEM_FEATURE		0xb0
+#define ITEM_END_COLLECTION	0xc0
+#define ITEM_USAGE_PAGE		0x04
+#define ITEM_LOGICAL_MIN	0x14
+#define ITEM_REPORT_SIZE	0x74
+#define ITEM_REPORT_ID		0x84
+#define ITEM_REPORT_COUNT	0x94
+#define ITEM_PUSH		0xa4
+#define ITEM_POP		0xb4
+#define ITEM_USAGE		0x08
+#define ITEM_USAGE_MIN		0x18
+#define ITEM_USAGE_MAX		0x28
+
+#define MAX_USAGES		64
+#define MAX_PUSH		4
+
+static const struct {
+	uint32_t usage;
+	uint8_t target;
+} usage_table[] = {
+	{ 0x00010030, HID_PEN_X },
+	{ 0x00010031, HID_PEN_Y },
+	{ 0x00010032, HID_PEN_DISTANCE },	/* Z */
+	{ 0x00010038, HID_PEN_WHEEL },
+	{ 0x000d0030, HID_PEN_PRESSURE },	/* Tip Pressure */
+	{ 0x000d0032, HID_PEN_IN_RANGE },
+	{ 0x000d003c, HID_PEN_INVERT },
+	{ 0x000d003d, HID_PEN_TILT_X },
+	{ 0x000d003e, HID_PEN_TILT_Y },
+	{ 0x000d0042, HID_PEN_TIP },
+	{ 0x000d0044, HID_PEN_BARREL },
+	{ 0x000d0045, HID_PEN_ERASER },
+	{ 0x000d005a, HID_PEN_BARREL2 },	/* Secondary Barrel Switch */
+	{ 0x000d005b, HID_PEN_SERIAL },		/* Transducer Serial Number */
+	{ 0xff0d0077, HID_PEN_TOOL_ID },	/* Wacom tool type */
+	{ 0xff0d0132, HID_PEN_DISTANCE },	/* Wacom distance */
+};
+
+struct globals {
+	uint32_t page;
+	int32_t logical_min;
+	uint32_t size;
+	uint32_t count;
+	uint32_t id;
+};
+
+static int lookup(uint32_t usage)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(usage_table) / sizeof(usage_table[0]); i++)
+		if (usage_table[i].usage == usage)
+			return usage_table[i].target;
+
+	/* the Wacom page repeats the digitizer usages */
+	if ((usage >> 16) == PAGE_WACOM)
+		return lookup((PAGE_DIGITIZER << 16) | (usage & 0xffff));
+
+	return -1;
+}
+
+static int is_pen_application(uint32_t usage)
+{
+	uint32_t page = usage >> 16;
+
+	if (page == PAGE_WACOM)
+		usage = (PAGE_DIGITIZER << 16) | (usage & 0xffff);
+
+	return usage == USAGE_PEN || usage == USAGE_DIGITIZER;
+}
+
+static void add_field(struct hid_pen *hp, const struct globals *g,
+		      uint32_t usage, uint32_t offset)
+{
+	struct hid_pen_field *f;
+	int target = lookup(usage);
+
+	if (target < 0 || g->size == 0 || g->size > 32 ||
+	    hp->nfields >= HID_PEN_MAX_FIELDS)
+		return;
+
+	f = &hp->fields[hp->nfields++];
+	f->report_id = g->id;
+	f->size = g->size;
+	f->is_signed = g->logical_min < 0;
+	f->target = target;
+	f->offset = offset;
+}
+
+/* Sort by report id, keeping descriptor order within a report */
+static void index_fields(struct hid_pen *hp)
+{
+	int i, j;
+
+	for (i = 1; i < hp->nfields; i++) {
+		struct hid_pen_field f = hp->fields[i];
+
+		for (j = i; j > 0 && hp->fields[j - 1].report_id > f.report_id; j--)
+			hp->fields[j] = hp->fields[j - 1];
+		hp->fields[j] = f;
+	}
+
+	memset(hp->first, 0, sizeof(hp->first));
+	memset(hp->count, 0, sizeof(hp->count));
+	for (i = hp->nfields - 1; i >= 0; i--) {
+		hp->first[hp->fields[i].report_id] = i;
+		hp->count[hp->fields[i].report_id]++;
+	}
+}
+
+int hid_pen_parse(struct hid_pen *hp, const uint8_t *desc, int size)
+{
+	struct globals g, stack[MAX_PUSH];
+	uint32_t usages[MAX_USAGES];
+	uint32_t usage_min = 0, usage_max = 0;
+	uint32_t offset[256];
+	uint32_t application = 0;
+	int nusages = 0, has_range = 0;
+	int depth = 0, sp = 0;
+	int pos = 0;
+
+	memset(hp, 0, sizeof(*hp));
+	memset(&g, 0, sizeof(g));
+	memset(offset, 0, sizeof(offset));
+
+	while (pos < size) {
+		uint8_t prefix = desc[pos++];
+		int len = prefix & 3;
+		uint32_t u = 0;
+		int32_t s;
+		int i;
+
+		if (prefix == 0xfe) {
+			/* long item, none are defined */
+			if (pos + 2 > size)
+				return -1;
+			pos += 2 + desc[pos];
+			continue;
+		}
+
+		if (len == 3)
+			len = 4;
+		if (pos + len > size)
+			return -1;
+
+		for (i = 0; i < len; i++)
+			u |= (uint32_t) desc[pos + i] << (8 * i);
+		pos += len;
+
+		/* sign extend for the items that are signed */
+		if (len == 1)
+			s = (int8_t) u;
+		else if (len == 2)
+			s = (int16_t) u;
+		else
+			s = (int32_t) u;
+
+		switch (prefix & 0xfc) {
+		case ITEM_INPUT:
+			/* variable, non-constant fields carry values; arrays
+			 * and padding only take up space */
+			if ((u & 0x03) == 0x02 && is_pen_application(application)) {
+				for (i = 0; i < (int) g.count; i++) {
+					uint32_t usage;
+
+					if (has_range)
+						usage = usage_min + i > usage_max ? usage_max : usage_min + i;
+					else if (nusages)
+						usage = usages[i < nusages ? i : nusages - 1];
+					else
+						break;
+
+					add_field(hp, &g, usage, offset[g.id] + i * g.size);
+				}
+			}
+			offset[g.id] += g.size * g.count;
+			nusages = has_range = 0;
+			break;
+		case ITEM_OUTPUT:
+		case ITEM_FEATURE:
+			nusages = has_range = 0;
+			break;
+		case ITEM_COLLECTION:
+			if (depth++ == 0)
+				application = nusages ? usages[0] : 0;
+			nusages = has_range = 0;
+			break;
+		case ITEM_END_COLLECTION:
+			if (depth > 0 && --depth == 0)
+				application = 0;
+			nusages = has_range = 0;
+			break;
+		case ITEM_USAGE_PAGE:
+			g.page = u;
+			break;
+		case ITEM_LOGICAL_MIN:
+			g.logical_min = s;
+			break;
+		case ITEM_REPORT_SIZE:
+			g.size = u;
+			break;
+		case ITEM_REPORT_ID:
+			if (u == 0 || u > 255)
+				return -1;
+			g.id = u;
+			hp->uses_ids = 1;
+			break;
+		case ITEM_REPORT_COUNT:
+			g.count = u;
+			break;
+		case ITEM_PUSH:
+			if (sp >= MAX_PUSH)
+				return -1;
+			stack[sp++] = g;
+			break;
+		case ITEM_POP:
+			if (sp == 0)
+				return -1;
+			g = stack[--sp];
+			break;
+		/* a 4 byte usage carries its own page */
+		case ITEM_USAGE:
+			if (nusages < MAX_USAGES)
+				usages[nusages++] = len == 4 ? u : (g.page << 16) | u;
+			break;
+		case ITEM_USAGE_MIN:
+			usage_min = len == 4 ? u : (g.page << 16) | u;
+			has_range = 1;
+			break;
+		case ITEM_USAGE_MAX:
+			usage_max = len == 4 ? u : (g.page << 16) | u;
+			has_range = 1;
+			break;
+		}
+	}
+
+	index_fields(hp);
+	return hp->nfields;
+}
+
+static int32_t extract(const uint8_t *data, int len, const struct hid_pen_field *f)
+{
+	uint64_t v = 0;
+	int byte = f->offset / 8;
+	int i;
+
+	for (i = 0; i < 5 && byte + i < len; i++)
+		v |= (uint64_t) data[byte + i] << (8 * i);
+
+	v = (v >> (f->offset % 8)) & ((1ULL << f->size) - 1);
+
+	if (f->is_signed && (v & (1ULL << (f->size - 1))))
+		v |= ~0ULL << f->size;
+
+	return (int32_t) v;
+}
+
+int hid_pen_decode(struct hid_pen *hp, const uint8_t *report, int size,
+		   const struct timeval *time, struct pen_frame *frame)
+{
+	struct pen_frame *prev = &hp->state;
+	struct pen_frame next = *prev;
+	int in_range = -1, invert = 0, touch = 0;
+	uint16_t buttons = prev->buttons;
+	const struct hid_pen_field *f;
+	int id = 0, i;
+
+	if (hp->uses_ids) {
+		if (size < 1)
+			return 0;
+		id = report[0];
+		report++;
+		size--;
+	}
+
+	if (hp->count[id] == 0)
+		return 0;
+
+	f = &hp->fields[hp->first[id]];
+	for (i = 0; i < hp->count[id]; i++, f++) {
+		int32_t v = extract(report, size, f);
+
+		switch (f->target) {
+		case HID_PEN_X:		next.x = v; break;
+		case HID_PEN_Y:		next.y = v; break;
+		case HID_PEN_PRESSURE:	next.pressure = v; break;
+		case HID_PEN_TILT_X:	next.tilt_x = v; break;
+		case HID_PEN_TILT_Y:	next.tilt_y = v; break;
+		case HID_PEN_DISTANCE:	next.distance = v; break;
+		case HID_PEN_WHEEL:	next.wheel = v; break;
+		case HID_PEN_TOOL_ID:	next.tool_id = v; break;
+		case HID_PEN_SERIAL:	next.serial = v; break;
+		case HID_PEN_IN_RANGE:	in_range = v != 0; break;
+		case HID_PEN_INVERT:	invert |= v != 0; break;
+		case HID_PEN_ERASER:	invert |= v != 0; touch |= v != 0; break;
+		case HID_PEN_TIP:	touch |= v != 0; break;
+		case HID_PEN_BARREL:
+			buttons = v ? buttons | PEN_BUTTON_STYLUS : buttons & ~PEN_BUTTON_STYLUS;
+			break;
+		case HID_PEN_BARREL2:
+			buttons = v ? buttons | PEN_BUTTON_STYLUS2 : buttons & ~PEN_BUTTON_STYLUS2;
+			break;
+		}
+	}
+
+	/* the eraser end reports its contact as Eraser, not Tip Switch */
+	buttons = touch ? buttons | PEN_BUTTON_TOUCH : buttons & ~PEN_BUTTON_TOUCH;
+	next.buttons = buttons;
+
+	/* without In Range, the pen counts as in range while touching */
+	if (in_range < 0)
+		in_range = touch;
+	next.tool = in_range ? (invert ? BTN_TOOL_RUBBER : BTN_TOOL_PEN) : 0;
+
+	next.time = *time;
+	next.changed = 0;
+	if (next.x != prev->x)			next.changed |= PEN_CHANGED_X;
+	if (next.y != prev->y)			next.changed |= PEN_CHANGED_Y;
+	if (next.pressure != prev->pressure)	next.changed |= PEN_CHANGED_PRESSURE;
+	if (next.tilt_x != prev->tilt_x ||
+	    next.tilt_y != prev->tilt_y)	next.changed |= PEN_CHANGED_TILT;
+	if (next.distance != prev->distance)	next.changed |= PEN_CHANGED_DISTANCE;
+	if (next.wheel != prev->wheel)		next.changed |= PEN_CHANGED_WHEEL;
+	if (next.tool != prev->tool ||
+	    next.tool_id != prev->tool_id)	next.changed |= PEN_CHANGED_TOOL;
+	if (next.buttons != prev->buttons)	next.changed |= PEN_CHANGED_BUTTONS;
+	if (next.serial != prev->serial)	next.changed |= PEN_CHANGED_SERIAL;
+
+	*prev = next;
+	*frame = next;
+	return 1;
+}
@@ -0,0 +1,92 @@
+/* Table driven pen report decoder for hidraw
+ *
+ * hid_pen_parse() walks the HID report descriptor once and turns every
+ * input field of a digitizer pen collection that we know (position,
+ * tip pressure, tilt, in range, tip and barrel switches, invert and
+ * eraser, transducer serial, ...) into a table entry: report id, bit
+ * offset, bit size, signedness and the pen_frame member it feeds.
+ * hid_pen_decode() then only extracts bit fields, no descriptor logic
+ * runs per report, and fills in the same pen_frame the evdev samples
+ * use (see pen-frame.h).
+ *
+ * Only devices that describe their pen reports with the HID digitizer
+ * usages, on the standard (0x0D) or the Wacom (0xFF0D) usage page, can
+ * be decoded. Older Wacom tablets with vendor defined reports are
+ * decoded by model in the kernel driver and yield no fields here.
+ */
+
+#ifndef HID_PEN_H
+#define HID_PEN_H
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <linux/hid.h>
+
+#include "pen-frame.h"
+
+#define HID_PEN_MAX_FIELDS	128
+
+enum hid_pen_target {
+	HID_PEN_X,
+	HID_PEN_Y,
+	HID_PEN_PRESSURE,
+	HID_PEN_TILT_X,
+	HID_PEN_TILT_Y,
+	HID_PEN_DISTANCE,
+	HID_PEN_WHEEL,
+	HID_PEN_TOOL_ID,
+	HID_PEN_SERIAL,
+	HID_PEN_IN_RANGE,
+	HID_PEN_TIP,
+	HID_PEN_BARREL,
+	HID_PEN_BARREL2,
+	HID_PEN_INVERT,
+	HID_PEN_ERASER,
+};
+
+struct hid_pen_field {
+	uint8_t report_id;
+	uint8_t size;		/* bits, at most 32 */
+	uint8_t is_signed;
+	uint8_t target;		/* enum hid_pen_target */
+	uint16_t offset;	/* bits from the start of the report data */
+};
+
+struct hid_pen {
+	int uses_ids;		/* reports start with a report id byte */
+	int nfields;
+	struct hid_pen_field fields[HID_PEN_MAX_FIELDS];	/* sorted by report id */
+	uint8_t first[256];	/* first field of each report id */
+	uint8_t count[256];	/* number of fields of each report id */
+	struct pen_frame state;
+};
+
+/* Dump written by hidraw-pen -w: the report descriptor as
+ * HIDIOCGRDESC returns it, then every report as read from hidraw
+ */
+#define HID_PEN_DUMP_MAGIC	"WACOMHID"
+
+struct hid_pen_dump_header {
+	char magic[8];
+	uint32_t desc_size;
+	uint8_t desc[HID_MAX_DESCRIPTOR_SIZE];
+};
+
+/* followed by size bytes of report */
+struct hid_pen_dump_record {
+	uint64_t time_us;
+	uint16_t size;
+} __attribute__((packed));
+
+/* Build the field table from a report descriptor. Returns the number
+ * of pen fields found, -1 if the descriptor is malformed.
+ */
+int hid_pen_parse(struct hid_pen *hp, const uint8_t *desc, int size);
+
+/* Decode one report as read from /dev/hidrawN. Returns 1 and fills in
+ * frame if it was a pen report, 0 otherwise.
+ */
+int hid_pen_decode(struct hid_pen *hp, const uint8_t *report, int size,
+		   const struct timeval *time, struct pen_frame *frame);
+
+#endif /* HID_PEN_H */
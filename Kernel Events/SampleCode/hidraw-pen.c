@@ -0,0 +1,362 @@
+/* print pen reports read straight from hidraw, without the input layer
+ *
+ * to compile:
+ *  gcc -o hidraw-pen hidraw-pen.c hid-pen.c pen-frame.c histogram.c
+ *
+ * to run:
+ *  the first Wacom hidraw node with pen reports, found the way
+ *  find-leds.c walks /sys/bus/hid/drivers/wacom:
+ *  sudo ./hidraw-pen
+ *
+ *  or a given node:
+ *  sudo ./hidraw-pen /dev/hidrawN
+ *
+ *  save the report descriptor and every report to a dump while printing:
+ *  sudo ./hidraw-pen -w pen.dump
+ *
+ *  decode a dump again, no tablet needed:
+ *  ./hidraw-pen -r pen.dump
+ *
+ *  measure how much later the same reports arrive through evdev; the
+ *  histogram is printed on ctrl-c:
+ *  sudo ./hidraw-pen -e /dev/input/eventX
+ *
+ * Reports are decoded with a field table built from the HID report
+ * descriptor (see hid-pen.h) into the same pen_frame pressure.c prints,
+ * so the output of both can be compared line by line. A dump replays
+ * the same bytes through the same decoder, which makes it usable to
+ * check decoder changes against reports captured on real hardware.
+ *
+ * The wacom kernel driver keeps reading the device as usual; hidraw
+ * readers get their own copy of every report.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/hidraw.h>
+
+#include "hid-pen.h"
+#include "pen-frame.h"
+#include "histogram.h"
+
+#define WACOM_DRIVER	"/sys/bus/hid/drivers/wacom"
+#define MAX_REPORT	1024
+#define PENDING		64	/* hidraw frames waiting for their evdev twin */
+
+struct pending {
+	int32_t x, y, pressure;
+	uint64_t time_us;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void sighandler(int signal)
+{
+	running = 0;
+}
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void print_frame(const struct pen_frame *frame)
+{
+	if (!(frame->changed & (PEN_CHANGED_X | PEN_CHANGED_Y | PEN_CHANGED_PRESSURE)))
+		return;
+
+	printf("%-6s x value %6d\ty value %6d\tpressure value %4d\n",
+		pen_tool_name(frame->tool),
+		frame->x,
+		frame->y,
+		frame->pressure);
+}
+
+/* Open the first hidraw node of a device bound to the wacom driver
+ * whose descriptor has pen fields */
+static int find_hidraw(struct hid_pen *hp, struct hid_pen_dump_header *hdr, char *path, size_t len)
+{
+	DIR *d, *h;
+	struct dirent *dir, *node;
+	char str[1024];
+	int fd = -1;
+
+	d = opendir(WACOM_DRIVER);
+	if (!d) {
+		perror(WACOM_DRIVER);
+		return -1;
+	}
+
+	while (fd < 0 && (dir = readdir(d)) != NULL) {
+		/* device entries start with the bus number, e.g. 0003: */
+		if (dir->d_name[0] != '0')
+			continue;
+
+		snprintf(str, sizeof(str), "%s/%s/hidraw", WACOM_DRIVER, dir->d_name);
+		h = opendir(str);
+		if (!h)
+			continue;
+
+		while (fd < 0 && (node = readdir(h)) != NULL) {
+			if (strncmp(node->d_name, "hidraw", 6) != 0)
+				continue;
+
+			snprintf(path, len, "/dev/%s", node->d_name);
+			fd = open(path, O_RDONLY);
+			if (fd < 0)
+				continue;
+
+			if (ioctl(fd, HIDIOCGRDESCSIZE, &hdr->desc_size) < 0 ||
+			    ioctl(fd, HIDIOCGRDESC, &hdr->desc_size) < 0 ||
+			    hid_pen_parse(hp, hdr->desc, hdr->desc_size) <= 0) {
+				close(fd);
+				fd = -1;
+			}
+		}
+		closedir(h);
+	}
+	closedir(d);
+
+	return fd;
+}
+
+static int open_hidraw(const char *path, struct hid_pen *hp, struct hid_pen_dump_header *hdr)
+{
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		perror(path);
+		return -1;
+	}
+
+	/* struct hidraw_report_descriptor is a size followed by the bytes,
+	 * the same layout as the tail of our dump header */
+	if (ioctl(fd, HIDIOCGRDESCSIZE, &hdr->desc_size) < 0 ||
+	    ioctl(fd, HIDIOCGRDESC, &hdr->desc_size) < 0) {
+		perror("HIDIOCGRDESC");
+		close(fd);
+		return -1;
+	}
+
+	if (hid_pen_parse(hp, hdr->desc, hdr->desc_size) <= 0) {
+		fprintf(stderr, "%s: no pen reports in the report descriptor\n", path);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int replay_dump(const char *path)
+{
+	static struct hid_pen_dump_header hdr;
+	struct hid_pen_dump_record rec;
+	struct hid_pen hp;
+	struct pen_frame frame;
+	struct timeval tv;
+	uint8_t report[MAX_REPORT];
+	unsigned long nreports = 0, nframes = 0;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, HID_PEN_DUMP_MAGIC, 8) != 0 ||
+	    hdr.desc_size > HID_MAX_DESCRIPTOR_SIZE ||
+	    hid_pen_parse(&hp, hdr.desc, hdr.desc_size) < 0) {
+		fprintf(stderr, "%s: not a hidraw dump\n", path);
+		fclose(f);
+		return 1;
+	}
+
+	while (running && fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.size > sizeof(report) || fread(report, rec.size, 1, f) != 1) {
+			fprintf(stderr, "%s: truncated\n", path);
+			break;
+		}
+
+		tv.tv_sec = rec.time_us / 1000000;
+		tv.tv_usec = rec.time_us % 1000000;
+		nreports++;
+		if (hid_pen_decode(&hp, report, rec.size, &tv, &frame)) {
+			nframes++;
+			print_frame(&frame);
+		}
+	}
+
+	fprintf(stderr, "%s: %lu reports, %lu pen reports, %d fields\n",
+		path, nreports, nframes, hp.nfields);
+	fclose(f);
+	return 0;
+}
+
+/* Match an evdev frame against the hidraw frames not seen on evdev yet;
+ * the kernel drops reports in which nothing changed, so older entries
+ * without a match are discarded */
+static void match_evdev(struct pending *p, int *np, const struct pen_frame *frame,
+			uint64_t t, struct histogram *lag)
+{
+	int i;
+
+	for (i = 0; i < *np; i++) {
+		if (p[i].x == frame->x && p[i].y == frame->y &&
+		    p[i].pressure == frame->pressure) {
+			hist_record(lag, t > p[i].time_us ? t - p[i].time_us : 0);
+			memmove(p, p + i + 1, (*np - i - 1) * sizeof(*p));
+			*np -= i + 1;
+			return;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static struct hid_pen_dump_header hdr;
+	struct hid_pen hp;
+	struct pen_assembler pa;
+	struct pen_frame frame, evframe;
+	struct pending pending[PENDING];
+	struct histogram lag;
+	struct pollfd fds[2];
+	struct sigaction sa;
+	struct timeval tv;
+	const char *dump = NULL, *evdev = NULL;
+	char path[300];
+	uint8_t report[MAX_REPORT];
+	FILE *out = NULL;
+	int npending = 0;
+	int fd, opt, n, nfds = 1;
+
+	while ((opt = getopt(argc, argv, "w:r:e:h")) != -1) {
+		switch (opt) {
+			case 'w': dump = optarg; break;
+			case 'r': return replay_dump(optarg);
+			case 'e': evdev = optarg; break;
+			default:
+				fprintf(stderr, "Usage: %s [-w dump] [-e /dev/input/eventX] [/dev/hidrawN]\n", argv[0]);
+				fprintf(stderr, "       %s -r dump\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	memcpy(hdr.magic, HID_PEN_DUMP_MAGIC, 8);
+	if (optind < argc) {
+		snprintf(path, sizeof(path), "%s", argv[optind]);
+		fd = open_hidraw(path, &hp, &hdr);
+	} else {
+		fd = find_hidraw(&hp, &hdr, path, sizeof(path));
+		if (fd < 0)
+			fprintf(stderr, "no Wacom hidraw node with pen reports found\n");
+	}
+	if (fd < 0)
+		exit(1);
+
+	fprintf(stderr, "%s: %d pen fields, report ids %s\n",
+		path, hp.nfields, hp.uses_ids ? "yes" : "no");
+
+	if (dump) {
+		out = fopen(dump, "wb");
+		if (!out || fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+			perror(dump);
+			exit(1);
+		}
+	}
+
+	fds[0].fd = fd;
+	fds[0].events = POLLIN;
+
+	if (evdev) {
+		fds[1].fd = open(evdev, O_RDONLY | O_NONBLOCK);
+		if (fds[1].fd < 0) {
+			perror(evdev);
+			exit(1);
+		}
+		fds[1].events = POLLIN;
+		nfds = 2;
+		pen_assembler_init(&pa, fds[1].fd);
+		pen_assembler_resync(&pa);
+		hist_init(&lag);
+	}
+
+	while (running && poll(fds, nfds, -1) >= 0) {
+		uint64_t t;
+
+		if (fds[0].revents & (POLLERR | POLLHUP))
+			break;
+
+		if (fds[0].revents & POLLIN) {
+			/* one read returns exactly one report */
+			n = read(fd, report, sizeof(report));
+			if (n <= 0) {
+				perror("read");
+				break;
+			}
+			t = now_us();
+
+			if (out) {
+				struct hid_pen_dump_record rec = { t, n };
+
+				if (fwrite(&rec, sizeof(rec), 1, out) != 1 ||
+				    fwrite(report, n, 1, out) != 1) {
+					perror(dump);
+					break;
+				}
+			}
+
+			tv.tv_sec = t / 1000000;
+			tv.tv_usec = t % 1000000;
+			if (hid_pen_decode(&hp, report, n, &tv, &frame)) {
+				if (evdev) {
+					if (npending == PENDING)
+						memmove(pending, pending + 1, --npending * sizeof(pending[0]));
+					pending[npending++] = (struct pending) { frame.x, frame.y, frame.pressure, t };
+				} else {
+					print_frame(&frame);
+				}
+			}
+		}
+
+		if (nfds > 1 && (fds[1].revents & POLLIN)) {
+			struct input_event events[64];
+			int i;
+
+			/* stamped on its own read, both nodes are often ready
+			 * in the same wakeup */
+			n = read(fds[1].fd, events, sizeof(events));
+			t = now_us();
+			for (i = 0; i < n / (int) sizeof(events[0]); i++)
+				if (pen_assembler_feed(&pa, &events[i], &evframe) &&
+				    (evframe.changed & (PEN_CHANGED_X | PEN_CHANGED_Y | PEN_CHANGED_PRESSURE)))
+					match_evdev(pending, &npending, &evframe, t, &lag);
+		}
+	}
+
+	if (evdev)
+		hist_print(stdout, "evdev behind hidraw", &lag, "us");
+
+	if (out)
+		fclose(out);
+	close(fd);
+	return 0;
+}
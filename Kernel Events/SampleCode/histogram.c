@@ -0,0 +1,107 @@
+/* Fixed size log-linear histogram (HDR style)
+ *
+ * See histogram.h. Bucket i < 2^HIST_SUB_BITS holds the value i. Above
+ * that every power of two is split into HIST_HALF equal buckets.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+static inline int hist_index(uint64_t v)
+{
+	int shift;
+
+	if (v < 2 * HIST_HALF)
+		return v;
+
+	/* shift v so it lands in [HIST_HALF, 2 * HIST_HALF) */
+	shift = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);
+	return (shift + 1) * HIST_HALF + (int) ((v >> shift) - HIST_HALF);
+}
+
+/* Highest value that falls into bucket i */
+static inline uint64_t hist_upper(int i)
+{
+	int shift;
+
+	if (i < 2 * HIST_HALF)
+		return i;
+
+	shift = i / HIST_HALF - 1;
+	return (((uint64_t) (i % HIST_HALF + HIST_HALF) + 1) << shift) - 1;
+}
+
+void hist_init(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+void hist_record(struct histogram *h, uint64_t value)
+{
+	h->buckets[hist_index(value)]++;
+	h->count++;
+	h->sum += value;
+	if (value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+}
+
+uint64_t hist_quantile(const struct histogram *h, double q)
+{
+	uint64_t rank, seen = 0;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+
+	rank = (uint64_t) (q * h->count);
+	if (rank >= h->count)
+		rank = h->count - 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > rank)
+			return hist_upper(i) < h->max ? hist_upper(i) : h->max;
+	}
+
+	return h->max;
+}
+
+uint64_t hist_count_above(const struct histogram *h, uint64_t v)
+{
+	uint64_t n = 0;
+	int i;
+
+	if (v >= h->max)
+		return 0;
+
+	for (i = hist_index(v) + 1; i < HIST_BUCKETS; i++)
+		n += h->buckets[i];
+
+	return n;
+}
+
+void hist_print(FILE *f, const char *label, const struct histogram *h,
+		const char *unit)
+{
+	if (h->count == 0) {
+		fprintf(f, "%s: no samples\n", label);
+		return;
+	}
+
+	fprintf(f, "%s: n=%llu min=%llu p50=%llu p99=%llu p99.9=%llu max=%llu mean=%.1f %s\n",
+		label,
+		(unsigned long long) h->count,
+		(unsigned long long) h->min,
+		(unsigned long long) hist_quantile(h, 0.5),
+		(unsigned long long) hist_quantile(h, 0.99),
+		(unsigned long long) hist_quantile(h, 0.999),
+		(unsigned long long) h->max,
+		(double) h->sum / h->count,
+		unit);
+}
@@ -0,0 +1,40 @@
+/* Fixed size log-linear histogram (HDR style)
+ *
+ * Values are counted exactly below 2^HIST_SUB_BITS and with a relative
+ * error of at most 1/2^(HIST_SUB_BITS - 1) above, in a fixed array, so
+ * recording a value is a handful of instructions and never allocates.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HIST_SUB_BITS	6
+#define HIST_HALF	(1 << (HIST_SUB_BITS - 1))
+#define HIST_MAX_SHIFT	(64 - HIST_SUB_BITS)
+#define HIST_BUCKETS	((HIST_MAX_SHIFT + 2) * HIST_HALF)
+
+struct histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+void hist_init(struct histogram *h);
+void hist_record(struct histogram *h, uint64_t value);
+
+/* Value at quantile q (0..1), the upper edge of its bucket */
+uint64_t hist_quantile(const struct histogram *h, double q);
+
+/* Number of values above v, to bucket precision */
+uint64_t hist_count_above(const struct histogram *h, uint64_t v);
+
+/* One line: count, min, p50, p99, p99.9, max and mean */
+void hist_print(FILE *f, const char *label, const struct histogram *h,
+		const char *unit);
+
+#endif /* HISTOGRAM_H */
@@ -2,11 +2,15 @@
  * Read device state with ioctls
  *
  * Compile:
- *	gcc -o ioctl ioctl.c
+ *	gcc -o ioctl ioctl.c axes.c
  * Run (example):
  *	sudo ./ioctl /dev/input/event5
  *
  * Based on http://www.linuxjournal.com/files/linuxjournal.com/linuxjournal/articles/064/6429/6429l17.html
+ *
+ * The EV_ABS bitmap tells which axes the device has; axes.c walks its
+ * set bits and asks for exactly those axes, so tilt, distance, wheel
+ * and the MT axes are shown too and nothing is asked for the rest.
  */
 
 #include <stdio.h>
@@ -16,10 +20,11 @@
 #include <unistd.h> // for close
 #include <stdlib.h>
 
+#include "axes.h"
+
 int main (int argc, const char * argv[]) {
 
-	uint8_t abs_b[ABS_MAX/8 + 1];
-	struct input_absinfo abs_feat;
+	struct axis_set set;
 	int fd, i;
 
 	if ((fd = open(argv[1], O_RDONLY)) < 0) {
@@ -27,35 +32,28 @@ int main (int argc, const char * argv[]) {
     		exit(1);
 	}
 
-	ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_b)), abs_b);
+	if (axis_set_init(&set, fd) < 0)
+		exit(1);
 
 	printf("Current axes values:\n");
 
-	for (i = 0; i < ABS_MAX; i++) {
-		switch (i) {
-			case ABS_X :
-				printf("X Axis - ");
-				break;
-			case ABS_Y :
-				printf("Y Axis - ");
-				break;
-			case ABS_PRESSURE :
-				printf("Pressure - ");
-				break;
-			/* You can check for other ABS_* values like tilt here */
-
-			default:
-				printf("Axis 0x%02x - skipped\n", i);
-				continue;
-		}
-		if(ioctl(fd, EVIOCGABS(i), &abs_feat))
-			perror("EVIOCGABS error");
-
-		printf("%d (min:%d max:%d flat:%d fuzz:%d)\n",
-			abs_feat.value,
-			abs_feat.minimum,
-			abs_feat.maximum,
-			abs_feat.flat,
-			abs_feat.fuzz);
+	for (i = 0; i < set.count; i++) {
+		const struct axis_info *a = &set.axes[i];
+
+		if (axis_name(a->code))
+			printf("%s - ", axis_name(a->code));
+		else
+			printf("Axis 0x%02x - ", a->code);
+
+		printf("%d (min:%d max:%d flat:%d fuzz:%d resolution:%d)\n",
+			a->value,
+			a->minimum,
+			a->maximum,
+			a->flat,
+			a->fuzz,
+			a->resolution);
 	}
+
+	close(fd);
+	return 0;
 }
@@ -0,0 +1,189 @@
+/* Per-device report interval and dropped report analysis
+ *
+ * See jitter.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/input.h>
+
+#include "jitter.h"
+
+int jitter_init(struct jitter *j, const struct capture *cap, double gap_factor)
+{
+	int i;
+
+	memset(j, 0, sizeof(*j));
+	j->gap_factor = gap_factor;
+
+	for (i = 0; i < cap->ndevices; i++) {
+		struct jitter_device *d = malloc(sizeof(struct jitter_device));
+
+		if (!d) {
+			perror("malloc");
+			return -1;
+		}
+
+		memset(d, 0, sizeof(*d));
+		hist_init(&d->interval);
+		hist_init(&d->hw_interval);
+		hist_init(&d->skew);
+		d->last_us = -1;
+		j->dev[i] = d;
+	}
+
+	return 0;
+}
+
+void jitter_free(struct jitter *j)
+{
+	int i;
+
+	for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+		free(j->dev[i]);
+		j->dev[i] = NULL;
+	}
+}
+
+int jitter_clone(struct jitter *dst, const struct jitter *src)
+{
+	int i;
+
+	memset(dst, 0, sizeof(*dst));
+
+	for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+		if (!src->dev[i])
+			continue;
+		dst->dev[i] = malloc(sizeof(struct jitter_device));
+		if (!dst->dev[i]) {
+			perror("malloc");
+			return -1;
+		}
+	}
+
+	jitter_copy(dst, src);
+	return 0;
+}
+
+void jitter_copy(struct jitter *dst, const struct jitter *src)
+{
+	int i;
+
+	dst->gap_factor = src->gap_factor;
+	for (i = 0; i < CAPTURE_MAX_DEVICES; i++)
+		if (src->dev[i])
+			*dst->dev[i] = *src->dev[i];
+}
+
+static void end_frame(struct jitter_device *d, const struct input_event *ev)
+{
+	int64_t t = (int64_t) ev->time.tv_sec * 1000000 + ev->time.tv_usec;
+	int64_t interval = t - d->last_us;
+	int counted = 0;
+
+	d->reports++;
+
+	if (d->last_us >= 0 && interval >= 0) {
+		hist_record(&d->interval, interval);
+		counted = 1;
+	}
+
+	if (d->frame_has_hw) {
+		/* the tablet clock is a free running 32 bit counter */
+		uint32_t hw = d->frame_hw - d->last_hw;
+
+		if (counted && d->has_hw) {
+			hist_record(&d->hw_interval, hw);
+			hist_record(&d->skew, interval > hw ? interval - hw : hw - interval);
+		}
+		d->last_hw = d->frame_hw;
+		d->has_hw = 1;
+	} else {
+		d->has_hw = 0;
+	}
+
+	d->last_us = d->frame_ends_burst ? -1 : t;
+	d->frame_has_hw = 0;
+	d->frame_ends_burst = 0;
+}
+
+void jitter_record(struct jitter *j, const struct capture_device *dev,
+		   const struct input_event *events, int count)
+{
+	struct jitter_device *d = j->dev[dev->index];
+	int i;
+
+	if (!d)
+		return;
+
+	for (i = 0; i < count; i++) {
+		const struct input_event *ev = &events[i];
+
+		switch (ev->type) {
+		case EV_SYN:
+			if (ev->code == SYN_REPORT) {
+				end_frame(d, ev);
+			} else if (ev->code == SYN_DROPPED) {
+				d->dropped++;
+				d->last_us = -1;
+				d->has_hw = 0;
+			}
+			break;
+		case EV_MSC:
+			if (ev->code == MSC_TIMESTAMP) {
+				d->frame_hw = ev->value;
+				d->frame_has_hw = 1;
+			}
+			break;
+		case EV_KEY:
+			/* BTN_TOOL_*, BTN_TOUCH and the stylus buttons sit
+			 * between BTN_TOOL_QUINTTAP and BTN_TOOL_DOUBLETAP */
+			if (ev->value == 0 &&
+			    ((ev->code >= BTN_TOOL_PEN && ev->code <= BTN_TOOL_QUINTTAP) ||
+			     (ev->code >= BTN_TOOL_DOUBLETAP && ev->code <= BTN_TOOL_QUADTAP)))
+				d->frame_ends_burst = 1;
+			break;
+		}
+	}
+}
+
+void jitter_print(FILE *f, const struct jitter *j, const struct capture *cap)
+{
+	int i;
+
+	fprintf(f, "%-20s %8s %7s %7s %7s %8s %6s %7s %7s %7s %8s\n",
+		"device", "reports", "rate Hz", "p50 us", "p99 us", "max us",
+		"gaps", "dropped", "hw p50", "hw p99", "skew p99");
+
+	for (i = 0; i < cap->ndevices; i++) {
+		const struct jitter_device *d = j->dev[i];
+		uint64_t p50;
+
+		if (!d)
+			continue;
+
+		p50 = hist_quantile(&d->interval, 0.5);
+
+		fprintf(f, "%-20s %8lu %7.0f %7llu %7llu %8llu %6llu %7lu",
+			cap->devices[i].path,
+			d->reports,
+			p50 ? 1e6 / p50 : 0.0,
+			(unsigned long long) p50,
+			(unsigned long long) hist_quantile(&d->interval, 0.99),
+			(unsigned long long) d->interval.max,
+			(unsigned long long) hist_count_above(&d->interval, (uint64_t) (p50 * j->gap_factor)),
+			d->dropped);
+
+		if (d->hw_interval.count)
+			fprintf(f, " %7llu %7llu %8llu\n",
+				(unsigned long long) hist_quantile(&d->hw_interval, 0.5),
+				(unsigned long long) hist_quantile(&d->hw_interval, 0.99),
+				(unsigned long long) hist_quantile(&d->skew, 0.99));
+		else
+			fprintf(f, " %7s %7s %8s\n", "-", "-", "-");
+	}
+
+	fprintf(f, "gaps: intervals over %.1f x p50\n", j->gap_factor);
+	fflush(f);
+}
@@ -0,0 +1,60 @@
+/* Per-device report interval and dropped report analysis
+ *
+ * For every SYN_REPORT the time since the previous one is taken from
+ * the kernel timestamps, which are set when the report arrives from the
+ * transport, and, if the device sends MSC_TIMESTAMP, from the tablet's
+ * own clock. A steady hardware interval with a jittery kernel interval
+ * points at USB or Bluetooth; steady intervals on both sides while the
+ * application stutters point at userspace, which event-log -L measures.
+ *
+ * Intervals across a tool leaving proximity or a SYN_DROPPED are not
+ * counted, those are pauses, not jitter. Every interval within a burst
+ * is, however long: a stall while the tool is in proximity is what
+ * shows up as a gap.
+ */
+
+#ifndef JITTER_H
+#define JITTER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+#include "capture.h"
+#include "histogram.h"
+
+struct jitter_device {
+	struct histogram interval;	/* kernel timestamps, us */
+	struct histogram hw_interval;	/* MSC_TIMESTAMP, us */
+	struct histogram skew;		/* |kernel - hardware interval|, us */
+	unsigned long reports;
+	unsigned long dropped;		/* SYN_DROPPED */
+	int64_t last_us;		/* -1 after a pause */
+	uint32_t last_hw;
+	int has_hw;			/* last_hw is valid */
+	uint32_t frame_hw;		/* MSC_TIMESTAMP of the current frame */
+	int frame_has_hw;
+	int frame_ends_burst;		/* tool left proximity in this frame */
+};
+
+struct jitter {
+	double gap_factor;		/* a gap is an interval > factor * p50 */
+	struct jitter_device *dev[CAPTURE_MAX_DEVICES];
+};
+
+int jitter_init(struct jitter *j, const struct capture *cap, double gap_factor);
+void jitter_free(struct jitter *j);
+
+/* Allocate dst as a copy of src, once at startup */
+int jitter_clone(struct jitter *dst, const struct jitter *src);
+
+/* Copy src into a clone of it, never allocates */
+void jitter_copy(struct jitter *dst, const struct jitter *src);
+
+void jitter_record(struct jitter *j, const struct capture_device *dev,
+		   const struct input_event *events, int count);
+
+/* One row per device */
+void jitter_print(FILE *f, const struct jitter *j, const struct capture *cap);
+
+#endif /* JITTER_H */
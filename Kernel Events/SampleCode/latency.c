@@ -0,0 +1,125 @@
+/* Per-device latency between the kernel event timestamp and read()
+ *
+ * See latency.h. input_event only carries microseconds, so that is the
+ * resolution of the histograms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "latency.h"
+
+int latency_init(struct latency *lat, struct capture *cap)
+{
+	int clk = CLOCK_MONOTONIC;
+	int i;
+
+	memset(lat, 0, sizeof(*lat));
+
+	for (i = 0; i < cap->ndevices; i++) {
+		struct capture_device *dev = &cap->devices[i];
+
+		/* the kernel flushes the queue when the clock changes, so
+		 * nothing stamped with the old clock is read afterwards */
+		if (ioctl(dev->fd, EVIOCSCLOCKID, &clk) < 0)
+			perror("EVIOCSCLOCKID");
+
+		lat->hist[i] = malloc(sizeof(struct histogram));
+		if (!lat->hist[i]) {
+			perror("malloc");
+			return -1;
+		}
+		hist_init(lat->hist[i]);
+	}
+
+	return 0;
+}
+
+void latency_free(struct latency *lat)
+{
+	int i;
+
+	for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+		free(lat->hist[i]);
+		lat->hist[i] = NULL;
+	}
+}
+
+int latency_clone(struct latency *dst, const struct latency *src)
+{
+	int i;
+
+	memset(dst, 0, sizeof(*dst));
+
+	for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+		if (!src->hist[i])
+			continue;
+		dst->hist[i] = malloc(sizeof(struct histogram));
+		if (!dst->hist[i]) {
+			perror("malloc");
+			return -1;
+		}
+	}
+
+	latency_copy(dst, src);
+	return 0;
+}
+
+void latency_copy(struct latency *dst, const struct latency *src)
+{
+	int i;
+
+	for (i = 0; i < CAPTURE_MAX_DEVICES; i++) {
+		if (src->hist[i])
+			*dst->hist[i] = *src->hist[i];
+		dst->future[i] = src->future[i];
+	}
+}
+
+void latency_record(struct latency *lat, const struct capture_device *dev,
+		    const struct input_event *events, int count)
+{
+	struct histogram *h = lat->hist[dev->index];
+	struct timespec ts;
+	int64_t now, t;
+	int i;
+
+	if (!h)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	for (i = 0; i < count; i++) {
+		const struct input_event *ev = &events[i];
+
+		if (ev->type != EV_SYN || ev->code != SYN_REPORT)
+			continue;
+
+		t = (int64_t) ev->time.tv_sec * 1000000 + ev->time.tv_usec;
+		if (t > now)
+			lat->future[dev->index]++;
+		else
+			hist_record(h, now - t);
+	}
+}
+
+void latency_print(FILE *f, const struct latency *lat,
+		   const struct capture *cap)
+{
+	int i;
+
+	for (i = 0; i < cap->ndevices; i++) {
+		if (!lat->hist[i])
+			continue;
+		hist_print(f, cap->devices[i].path, lat->hist[i], "us");
+		if (lat->future[i])
+			fprintf(f, "%s: %lu reports stamped after they were read, wrong clock?\n",
+				cap->devices[i].path, lat->future[i]);
+	}
+	fflush(f);
+}
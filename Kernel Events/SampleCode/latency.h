@@ -0,0 +1,39 @@
+/* Per-device latency between the kernel event timestamp and read()
+ *
+ * Every device is switched to CLOCK_MONOTONIC timestamps with
+ * EVIOCSCLOCKID so they can be compared with clock_gettime() right
+ * after the read that returned them. One sample is taken per
+ * SYN_REPORT, which is when a report becomes visible to readers.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <linux/input.h>
+
+#include "capture.h"
+#include "histogram.h"
+
+struct latency {
+	struct histogram *hist[CAPTURE_MAX_DEVICES];
+	unsigned long future[CAPTURE_MAX_DEVICES];	/* event time after read time */
+};
+
+int latency_init(struct latency *lat, struct capture *cap);
+void latency_free(struct latency *lat);
+
+/* Call right after the read that returned events */
+void latency_record(struct latency *lat, const struct capture_device *dev,
+		    const struct input_event *events, int count);
+
+/* Allocate dst as a copy of src, once at startup */
+int latency_clone(struct latency *dst, const struct latency *src);
+
+/* Copy src into a clone of it, never allocates */
+void latency_copy(struct latency *dst, const struct latency *src);
+
+void latency_print(FILE *f, const struct latency *lat,
+		   const struct capture *cap);
+
+#endif /* LATENCY_H */
@@ -0,0 +1,205 @@
+/* Multitouch protocol B slot tracker
+ *
+ * See mt-slots.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "mt-slots.h"
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
+
+static const uint16_t mt_codes[MT_NCOLUMNS] = {
+	[MT_TRACKING_ID] = ABS_MT_TRACKING_ID,
+	[MT_POSITION_X] = ABS_MT_POSITION_X,
+	[MT_POSITION_Y] = ABS_MT_POSITION_Y,
+	[MT_TOUCH_MAJOR] = ABS_MT_TOUCH_MAJOR,
+	[MT_TOUCH_MINOR] = ABS_MT_TOUCH_MINOR,
+	[MT_ORIENTATION] = ABS_MT_ORIENTATION,
+	[MT_PRESSURE] = ABS_MT_PRESSURE,
+};
+
+/* ABS_MT_* code -> column, -1 for codes we don't track */
+static int mt_column_of(uint16_t code)
+{
+	static int8_t table[ABS_CNT];
+	static int ready;
+	int c;
+
+	if (!ready) {
+		memset(table, -1, sizeof(table));
+		for (c = 0; c < MT_NCOLUMNS; c++)
+			table[mt_codes[c]] = c;
+		ready = 1;
+	}
+
+	return code < ABS_CNT ? table[code] : -1;
+}
+
+static inline void mt_mark(struct mt_state *mt, int slot)
+{
+	mt->changed[slot / 64] |= 1ULL << (slot % 64);
+}
+
+int mt_init(struct mt_state *mt, int fd)
+{
+	unsigned long bits[NBITS(ABS_CNT)];
+	struct input_absinfo abs;
+	int32_t *data;
+	int c, s;
+
+	memset(mt, 0, sizeof(*mt));
+	mt->fd = fd;
+
+	/* EVIOCGABS answers with a zeroed range for a code the device lacks,
+	 * which would look like a one slot device */
+	memset(bits, 0, sizeof(bits));
+	if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(bits)), bits) < 0) {
+		perror("EVIOCGBIT");
+		return -1;
+	}
+
+	if (!((bits[ABS_MT_SLOT / BITS_PER_LONG] >> (ABS_MT_SLOT % BITS_PER_LONG)) & 1) ||
+	    ioctl(fd, EVIOCGABS(ABS_MT_SLOT), &abs) < 0 || abs.maximum < 0) {
+		fprintf(stderr, "not a multitouch protocol B device\n");
+		return -1;
+	}
+	mt->nslots = abs.maximum + 1;
+	mt->slot = abs.value;
+
+	/* all columns, the changed bits and the resync buffer in one go */
+	data = calloc((size_t) mt->nslots * MT_NCOLUMNS, sizeof(int32_t));
+	mt->changed = calloc((mt->nslots + 63) / 64, sizeof(uint64_t));
+	mt->scratch = calloc(mt->nslots + 1, sizeof(int32_t));
+	if (!data || !mt->changed || !mt->scratch) {
+		perror("calloc");
+		free(data);
+		mt_free(mt);
+		return -1;
+	}
+
+	for (c = 0; c < MT_NCOLUMNS; c++)
+		mt->columns[c] = data + (size_t) c * mt->nslots;
+	for (s = 0; s < mt->nslots; s++)
+		mt->columns[MT_TRACKING_ID][s] = -1;
+
+	/* build the code lookup table now, not on the first event */
+	mt_column_of(0);
+	return mt_resync(mt);
+}
+
+void mt_free(struct mt_state *mt)
+{
+	free(mt->columns[0]);
+	free(mt->changed);
+	free(mt->scratch);
+	memset(mt->columns, 0, sizeof(mt->columns));
+	mt->changed = NULL;
+	mt->scratch = NULL;
+}
+
+int mt_resync(struct mt_state *mt)
+{
+	size_t size = (mt->nslots + 1) * sizeof(int32_t);
+	struct input_absinfo abs;
+	int c, s;
+
+	for (c = 0; c < MT_NCOLUMNS; c++) {
+		/* one ioctl returns the value of one axis for every slot;
+		 * axes the device doesn't have come back as zero */
+		memset(mt->scratch, 0, size);
+		mt->scratch[0] = mt_codes[c];
+		if (ioctl(mt->fd, EVIOCGMTSLOTS(size), mt->scratch) < 0) {
+			perror("EVIOCGMTSLOTS");
+			return -1;
+		}
+		memcpy(mt->columns[c], &mt->scratch[1], mt->nslots * sizeof(int32_t));
+	}
+
+	if (ioctl(mt->fd, EVIOCGABS(ABS_MT_SLOT), &abs) == 0)
+		mt->slot = abs.value;
+
+	mt->ncontacts = 0;
+	for (s = 0; s < mt->nslots; s++) {
+		if (mt->columns[MT_TRACKING_ID][s] != -1)
+			mt->ncontacts++;
+		mt_mark(mt, s);
+	}
+
+	mt->nresyncs++;
+	return 0;
+}
+
+int mt_feed(struct mt_state *mt, const struct input_event *ev)
+{
+	int c;
+
+	if (ev->type == EV_SYN) {
+		if (ev->code == SYN_DROPPED) {
+			mt->dropped = 1;
+			return 0;
+		}
+		if (ev->code != SYN_REPORT)
+			return 0;
+
+		if (mt->dropped) {
+			mt->dropped = 0;
+			mt_resync(mt);
+		}
+		return 1;
+	}
+
+	if (mt->dropped || ev->type != EV_ABS)
+		return 0;
+
+	if (ev->code == ABS_MT_SLOT) {
+		mt->slot = ev->value;
+		return 0;
+	}
+
+	c = mt_column_of(ev->code);
+	if (c < 0 || mt->slot < 0 || mt->slot >= mt->nslots)
+		return 0;
+
+	if (c == MT_TRACKING_ID) {
+		int32_t old = mt->columns[c][mt->slot];
+
+		if (old == -1 && ev->value != -1)
+			mt->ncontacts++;
+		else if (old != -1 && ev->value == -1)
+			mt->ncontacts--;
+	}
+
+	mt->columns[c][mt->slot] = ev->value;
+	mt_mark(mt, mt->slot);
+	return 0;
+}
+
+int mt_next_changed(const struct mt_state *mt, int after)
+{
+	int s = after + 1;
+	int w = s / 64;
+	uint64_t bits;
+
+	if (s >= mt->nslots)
+		return -1;
+
+	bits = mt->changed[w] & (~0ULL << (s % 64));
+	while (!bits) {
+		if (++w >= (mt->nslots + 63) / 64)
+			return -1;
+		bits = mt->changed[w];
+	}
+
+	return w * 64 + __builtin_ctzll(bits);
+}
+
+void mt_clear_changed(struct mt_state *mt)
+{
+	memset(mt->changed, 0, ((mt->nslots + 63) / 64) * sizeof(uint64_t));
+}
@@ -0,0 +1,61 @@
+/* Multitouch protocol B slot tracker
+ *
+ * Keeps the state of every slot of a touch node in a structure of
+ * arrays: one column per ABS_MT_* axis, each as long as the number of
+ * slots the device reports (ABS_MT_SLOT maximum + 1). Everything is
+ * allocated once in mt_init(), handling an event is an array store.
+ * Slots touched since the last SYN_REPORT are flagged in a bitmask.
+ * After SYN_DROPPED all columns are read back with EVIOCGMTSLOTS.
+ */
+
+#ifndef MT_SLOTS_H
+#define MT_SLOTS_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+enum mt_column {
+	MT_TRACKING_ID,		/* -1 if the slot is unused */
+	MT_POSITION_X,
+	MT_POSITION_Y,
+	MT_TOUCH_MAJOR,
+	MT_TOUCH_MINOR,
+	MT_ORIENTATION,
+	MT_PRESSURE,
+	MT_NCOLUMNS
+};
+
+struct mt_state {
+	int fd;
+	int nslots;
+	int slot;		/* slot the next ABS_MT_* events apply to */
+	int dropped;		/* discarding events up to the next SYN_REPORT */
+	int ncontacts;		/* slots with a tracking id */
+	unsigned long nresyncs;
+	int32_t *columns[MT_NCOLUMNS];	/* columns[c][slot] */
+	uint64_t *changed;	/* one bit per slot */
+	int32_t *scratch;	/* EVIOCGMTSLOTS buffer */
+};
+
+int mt_init(struct mt_state *mt, int fd);
+void mt_free(struct mt_state *mt);
+
+/* Feed one event, returns 1 when ev completes a frame */
+int mt_feed(struct mt_state *mt, const struct input_event *ev);
+
+/* Read all slots back from the device */
+int mt_resync(struct mt_state *mt);
+
+/* Iterate the slots changed in this frame, -1 when done */
+int mt_next_changed(const struct mt_state *mt, int after);
+
+/* Forget the changed flags, call after handling a frame */
+void mt_clear_changed(struct mt_state *mt);
+
+static inline int32_t mt_value(const struct mt_state *mt, enum mt_column c,
+			       int slot)
+{
+	return mt->columns[c][slot];
+}
+
+#endif /* MT_SLOTS_H */
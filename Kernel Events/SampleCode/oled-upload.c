@@ -0,0 +1,351 @@
+/* upload button images to the OLEDs of a wacom_led device
+ *
+ * To compile:
+ *  gcc -o oled-upload oled-upload.c
+ *
+ * To run:
+ *  a profile is a directory with one raw image per button, button0.raw
+ *  to button7.raw, in the format the kernel expects (1024 bytes over
+ *  USB, 256 bytes over Bluetooth); buttons without a file are left
+ *  alone:
+ *  sudo ./oled-upload profiles/gimp
+ *
+ *  or keep running and switch profiles by writing their directory to
+ *  stdin, one per line, e.g. from a window manager hook:
+ *  sudo ./oled-upload -i
+ *
+ *  a given device instead of the first one with button images:
+ *  sudo ./oled-upload -d 0003:056A:00B9.0001 profiles/gimp
+ *
+ * Every image write goes out to the tablet over a slow control
+ * transfer, so a hash of the image last written to each button is
+ * kept, in memory and in a cache file per device, and only buttons
+ * whose image differs are written. On a profile switch all images are
+ * read and compared first and the changed ones written in one go.
+ * With -i, profile switches that pile up while a batch is written are
+ * coalesced and only the last one is applied.
+ *
+ * The cache is keyed by the sysfs device name, which changes when the
+ * tablet is plugged in again, so a replugged tablet, whose OLEDs are
+ * blank, gets all of its images again. The names start over after a
+ * reboot, so the cache lives in /run, which doesn't survive one. Only
+ * a cache file that belongs to us and nobody else can write is
+ * believed.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define WACOM_DRIVER	"/sys/bus/hid/drivers/wacom"
+#define CACHE_DIR	"/run"		/* tmpfs, root only */
+#define NBUTTONS	8
+#define MAX_IMAGE	1024
+
+struct oled {
+	char name[64];			/* entry in WACOM_DRIVER */
+	int fd[NBUTTONS];		/* buttonN_rawimg, -1 if missing */
+	uint64_t hash[NBUTTONS];	/* of the image on the button, 0: unknown */
+	char cache[512];
+};
+
+struct cache_file {
+	char magic[8];
+	char name[64];
+	uint64_t hash[NBUTTONS];
+};
+
+/* FNV-1a, 0 is kept for "unknown" */
+static uint64_t hash_image(const uint8_t *buf, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= buf[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h ? h : 1;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void load_cache(struct oled *o)
+{
+	struct cache_file c;
+	struct stat st;
+	FILE *f;
+	int fd;
+
+	fd = open(o->cache, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	/* planted by somebody else, it could hide buttons from us */
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	    st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+	    !(f = fdopen(fd, "rb"))) {
+		close(fd);
+		return;
+	}
+
+	if (fread(&c, sizeof(c), 1, f) == 1 &&
+	    memcmp(c.magic, "WACOMOLD", 8) == 0 &&
+	    strncmp(c.name, o->name, sizeof(c.name)) == 0)
+		memcpy(o->hash, c.hash, sizeof(o->hash));
+
+	fclose(f);
+}
+
+/* Write to a temporary file and rename, a crash never leaves a cache
+ * that claims images the buttons don't have. mkstemp() creates a file
+ * that didn't exist, never one somebody put a symlink in place of. */
+static void save_cache(const struct oled *o)
+{
+	struct cache_file c;
+	char tmp[600];
+	FILE *f;
+	int fd;
+
+	memset(&c, 0, sizeof(c));
+	memcpy(c.magic, "WACOMOLD", 8);
+	snprintf(c.name, sizeof(c.name), "%s", o->name);
+	memcpy(c.hash, o->hash, sizeof(c.hash));
+
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", o->cache);
+	fd = mkstemp(tmp);
+	if (fd < 0 || !(f = fdopen(fd, "wb"))) {
+		perror(tmp);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmp);
+		}
+		return;
+	}
+
+	if (fwrite(&c, sizeof(c), 1, f) != 1 || fclose(f) != 0 ||
+	    rename(tmp, o->cache) < 0) {
+		perror(o->cache);
+		unlink(tmp);
+	}
+}
+
+/* Open the image attributes of one device, returns the number found */
+static int open_oled(struct oled *o, const char *name)
+{
+	char path[512];
+	int i, found = 0;
+
+	memset(o, 0, sizeof(*o));
+	snprintf(o->name, sizeof(o->name), "%s", name);
+	snprintf(o->cache, sizeof(o->cache), "%s/wacom-oled.%s.cache", CACHE_DIR, name);
+
+	for (i = 0; i < NBUTTONS; i++) {
+		snprintf(path, sizeof(path), "%s/%s/wacom_led/button%d_rawimg",
+			 WACOM_DRIVER, name, i);
+		o->fd[i] = open(path, O_WRONLY | O_CLOEXEC);
+		if (o->fd[i] >= 0)
+			found++;
+	}
+
+	if (found)
+		load_cache(o);
+
+	return found;
+}
+
+static void close_oled(struct oled *o)
+{
+	int i;
+
+	for (i = 0; i < NBUTTONS; i++)
+		if (o->fd[i] >= 0)
+			close(o->fd[i]);
+}
+
+static int find_oled(struct oled *o)
+{
+	DIR *d;
+	struct dirent *dir;
+	int found = 0;
+
+	d = opendir(WACOM_DRIVER);
+	if (!d) {
+		perror(WACOM_DRIVER);
+		return 0;
+	}
+
+	while (!found && (dir = readdir(d)) != NULL) {
+		if (dir->d_name[0] != '0')
+			continue;
+		found = open_oled(o, dir->d_name) > 0;
+		if (!found)
+			close_oled(o);
+	}
+
+	closedir(d);
+	return found;
+}
+
+static int read_image(const char *dir, int button, uint8_t *buf)
+{
+	char path[600];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/button%d.raw", dir, button);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, buf, MAX_IMAGE);
+	close(fd);
+
+	return len;
+}
+
+/* Compare all images of a profile first, then write the changed ones */
+static void apply_profile(struct oled *o, const char *dir)
+{
+	static uint8_t images[NBUTTONS][MAX_IMAGE];
+	int len[NBUTTONS];
+	uint64_t hash[NBUTTONS];
+	int i, written = 0, unchanged = 0, failed = 0;
+	size_t bytes = 0;
+	double start;
+
+	for (i = 0; i < NBUTTONS; i++) {
+		len[i] = -1;
+		if (o->fd[i] < 0)
+			continue;
+
+		len[i] = read_image(dir, i, images[i]);
+		if (len[i] <= 0)
+			continue;
+
+		hash[i] = hash_image(images[i], len[i]);
+		if (hash[i] == o->hash[i]) {
+			unchanged++;
+			len[i] = -1;
+		}
+	}
+
+	start = now_ms();
+	for (i = 0; i < NBUTTONS; i++) {
+		if (len[i] <= 0)
+			continue;
+
+		/* the kernel wants the whole image in one write */
+		if (pwrite(o->fd[i], images[i], len[i], 0) != len[i]) {
+			fprintf(stderr, "button%d_rawimg: %s\n", i, strerror(errno));
+			o->hash[i] = 0;
+			failed++;
+			continue;
+		}
+
+		o->hash[i] = hash[i];
+		bytes += len[i];
+		written++;
+	}
+
+	printf("%s: %d written (%zu bytes, %.1f ms), %d unchanged, %d failed\n",
+	       dir, written, bytes, now_ms() - start, unchanged, failed);
+	fflush(stdout);
+
+	if (written || failed)
+		save_cache(o);
+}
+
+/* Read profile switches from stdin; of the lines that are already
+ * waiting only the last one matters */
+static void follow_stdin(struct oled *o)
+{
+	static char buf[4096];
+	char profile[4096] = "";
+	struct pollfd pfd = { .fd = 0, .events = POLLIN };
+	size_t fill = 0;
+	ssize_t n;
+	char *nl;
+
+	while (1) {
+		if (profile[0] && poll(&pfd, 1, 0) == 0) {
+			apply_profile(o, profile);
+			profile[0] = '\0';
+		}
+
+		n = read(0, buf + fill, sizeof(buf) - 1 - fill);
+		if (n <= 0)
+			break;
+		fill += n;
+		buf[fill] = '\0';
+
+		while ((nl = strchr(buf, '\n'))) {
+			*nl = '\0';
+			if (buf[0])
+				snprintf(profile, sizeof(profile), "%s", buf);
+			fill -= nl + 1 - buf;
+			memmove(buf, nl + 1, fill + 1);
+		}
+
+		/* a line longer than the buffer is not a profile */
+		if (fill == sizeof(buf) - 1)
+			fill = 0;
+	}
+
+	if (profile[0])
+		apply_profile(o, profile);
+}
+
+int main(int argc, char *argv[])
+{
+	struct oled o;
+	const char *device = NULL;
+	int interactive = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:ih")) != -1) {
+		switch (opt) {
+			case 'd': device = optarg; break;
+			case 'i': interactive = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s [-d device] profile-dir\n", argv[0]);
+				fprintf(stderr, "       %s [-d device] -i\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!interactive && optind >= argc) {
+		fprintf(stderr, "Usage: %s [-d device] profile-dir\n", argv[0]);
+		exit(1);
+	}
+
+	if (device ? open_oled(&o, device) == 0 : !find_oled(&o)) {
+		fprintf(stderr, "no wacom_led device with button images found\n");
+		exit(1);
+	}
+
+	printf("%s/%s\n", WACOM_DRIVER, o.name);
+
+	if (interactive)
+		follow_stdin(&o);
+	else
+		apply_profile(&o, argv[optind]);
+
+	close_oled(&o);
+	return(0);
+}
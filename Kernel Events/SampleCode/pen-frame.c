@@ -0,0 +1,224 @@
+/* Assemble pen events into one state struct per SYN_REPORT
+ *
+ * See pen-frame.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "pen-frame.h"
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
+#define OFF(x)  ((x)%BITS_PER_LONG)
+#define LONG(x) ((x)/BITS_PER_LONG)
+#define test_bit(bit, array)	((array[LONG(bit)] >> OFF(bit)) & 1)
+
+static const uint16_t pen_tools[] = {
+	BTN_TOOL_PEN, BTN_TOOL_RUBBER, BTN_TOOL_BRUSH, BTN_TOOL_PENCIL,
+	BTN_TOOL_AIRBRUSH, BTN_TOOL_MOUSE, BTN_TOOL_LENS,
+};
+
+static const struct {
+	uint16_t code;
+	uint16_t bit;
+} pen_buttons[] = {
+	{ BTN_TOUCH,	PEN_BUTTON_TOUCH },
+	{ BTN_STYLUS,	PEN_BUTTON_STYLUS },
+	{ BTN_STYLUS2,	PEN_BUTTON_STYLUS2 },
+	{ BTN_STYLUS3,	PEN_BUTTON_STYLUS3 },
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+void pen_assembler_init(struct pen_assembler *pa, int fd)
+{
+	memset(pa, 0, sizeof(*pa));
+	pa->fd = fd;
+}
+
+const char *pen_tool_name(uint16_t tool)
+{
+	switch (tool) {
+		case 0:			return "none";
+		case BTN_TOOL_PEN:	return "pen";
+		case BTN_TOOL_RUBBER:	return "eraser";
+		case BTN_TOOL_BRUSH:	return "brush";
+		case BTN_TOOL_PENCIL:	return "pencil";
+		case BTN_TOOL_AIRBRUSH:	return "airbrush";
+		case BTN_TOOL_MOUSE:	return "mouse";
+		case BTN_TOOL_LENS:	return "lens";
+		default:		return "unknown";
+	}
+}
+
+static void pen_set_abs(struct pen_frame *s, uint16_t code, int32_t value)
+{
+	switch (code) {
+		case ABS_X:
+			s->x = value;
+			s->changed |= PEN_CHANGED_X;
+			break;
+		case ABS_Y:
+			s->y = value;
+			s->changed |= PEN_CHANGED_Y;
+			break;
+		case ABS_PRESSURE:
+			s->pressure = value;
+			s->changed |= PEN_CHANGED_PRESSURE;
+			break;
+		case ABS_TILT_X:
+			s->tilt_x = value;
+			s->changed |= PEN_CHANGED_TILT;
+			break;
+		case ABS_TILT_Y:
+			s->tilt_y = value;
+			s->changed |= PEN_CHANGED_TILT;
+			break;
+		case ABS_DISTANCE:
+			s->distance = value;
+			s->changed |= PEN_CHANGED_DISTANCE;
+			break;
+		case ABS_WHEEL:
+			s->wheel = value;
+			s->changed |= PEN_CHANGED_WHEEL;
+			break;
+		case ABS_MISC:
+			s->tool_id = value;
+			s->changed |= PEN_CHANGED_TOOL;
+			break;
+	}
+}
+
+static void pen_set_key(struct pen_frame *s, uint16_t code, int32_t value)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(pen_buttons); i++) {
+		if (pen_buttons[i].code != code)
+			continue;
+		if (value)
+			s->buttons |= pen_buttons[i].bit;
+		else
+			s->buttons &= ~pen_buttons[i].bit;
+		s->changed |= PEN_CHANGED_BUTTONS;
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(pen_tools); i++) {
+		if (pen_tools[i] != code)
+			continue;
+		if (value)
+			s->tool = code;
+		else if (s->tool == code)
+			s->tool = 0;
+		s->changed |= PEN_CHANGED_TOOL;
+		return;
+	}
+}
+
+int pen_assembler_resync(struct pen_assembler *pa)
+{
+	static const uint16_t axes[] = {
+		ABS_X, ABS_Y, ABS_PRESSURE, ABS_TILT_X, ABS_TILT_Y,
+		ABS_DISTANCE, ABS_WHEEL, ABS_MISC,
+	};
+	unsigned long keys[NBITS(KEY_MAX)];
+	unsigned long absbits[NBITS(ABS_MAX)];
+	struct pen_frame *s = &pa->state;
+	struct input_absinfo absinfo;
+	unsigned int i;
+
+	memset(keys, 0, sizeof(keys));
+	memset(absbits, 0, sizeof(absbits));
+
+	/* one ioctl returns the state of every key */
+	if (ioctl(pa->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+		perror("EVIOCGKEY");
+		return -1;
+	}
+	if (ioctl(pa->fd, EVIOCGBIT(EV_ABS, sizeof(absbits)), absbits) < 0) {
+		perror("EVIOCGBIT");
+		return -1;
+	}
+
+	s->tool = 0;
+	for (i = 0; i < ARRAY_SIZE(pen_tools); i++)
+		if (test_bit(pen_tools[i], keys))
+			s->tool = pen_tools[i];
+
+	s->buttons = 0;
+	for (i = 0; i < ARRAY_SIZE(pen_buttons); i++)
+		if (test_bit(pen_buttons[i].code, keys))
+			s->buttons |= pen_buttons[i].bit;
+
+	for (i = 0; i < ARRAY_SIZE(axes); i++) {
+		if (!test_bit(axes[i], absbits))
+			continue;
+		if (ioctl(pa->fd, EVIOCGABS(axes[i]), &absinfo) < 0) {
+			perror("EVIOCGABS");
+			return -1;
+		}
+		pen_set_abs(s, axes[i], absinfo.value);
+	}
+
+	/* MSC_SERIAL has no query ioctl, keep the last one seen */
+	s->changed = PEN_CHANGED_ALL;
+	pa->nresyncs++;
+
+	return 0;
+}
+
+int pen_assembler_feed(struct pen_assembler *pa, const struct input_event *ev,
+		       struct pen_frame *frame)
+{
+	struct pen_frame *s = &pa->state;
+
+	if (ev->type == EV_SYN) {
+		switch (ev->code) {
+			case SYN_DROPPED:
+				pa->dropped = 1;
+				return 0;
+			case SYN_REPORT:
+				break;
+			default:
+				return 0;
+		}
+
+		if (pa->dropped) {
+			pa->dropped = 0;
+			if (pen_assembler_resync(pa) < 0)
+				return 0;
+			s->changed |= PEN_CHANGED_RESYNC;
+		}
+
+		s->time = ev->time;
+		*frame = *s;
+		s->changed = 0;
+		pa->nframes++;
+		return 1;
+	}
+
+	/* everything up to the SYN_REPORT after a SYN_DROPPED is stale */
+	if (pa->dropped)
+		return 0;
+
+	switch (ev->type) {
+		case EV_ABS:
+			pen_set_abs(s, ev->code, ev->value);
+			break;
+		case EV_KEY:
+			pen_set_key(s, ev->code, ev->value);
+			break;
+		case EV_MSC:
+			if (ev->code == MSC_SERIAL) {
+				s->serial = (uint32_t) ev->value;
+				s->changed |= PEN_CHANGED_SERIAL;
+			}
+			break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/* Assemble pen events into one state struct per SYN_REPORT
+ *
+ * The kernel only sends what changed since the last report, so a
+ * consumer has to carry the pen state across reports itself. The
+ * assembler does that and hands out a complete pen_frame every time a
+ * SYN_REPORT closes a report. After a SYN_DROPPED the rest of the
+ * report is discarded and the state is read back from the device with
+ * EVIOCGKEY and EVIOCGABS.
+ */
+
+#ifndef PEN_FRAME_H
+#define PEN_FRAME_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+/* pen_frame.buttons */
+#define PEN_BUTTON_TOUCH	(1 << 0)
+#define PEN_BUTTON_STYLUS	(1 << 1)
+#define PEN_BUTTON_STYLUS2	(1 << 2)
+#define PEN_BUTTON_STYLUS3	(1 << 3)
+
+/* pen_frame.changed */
+#define PEN_CHANGED_X		(1 << 0)
+#define PEN_CHANGED_Y		(1 << 1)
+#define PEN_CHANGED_PRESSURE	(1 << 2)
+#define PEN_CHANGED_TILT	(1 << 3)
+#define PEN_CHANGED_DISTANCE	(1 << 4)
+#define PEN_CHANGED_WHEEL	(1 << 5)
+#define PEN_CHANGED_TOOL	(1 << 6)
+#define PEN_CHANGED_BUTTONS	(1 << 7)
+#define PEN_CHANGED_SERIAL	(1 << 8)
+#define PEN_CHANGED_ALL		((1 << 9) - 1)
+#define PEN_CHANGED_RESYNC	(1 << 9)	/* frame was read back after SYN_DROPPED */
+
+struct pen_frame {
+	struct timeval time;	/* time of the SYN_REPORT */
+	int32_t x;
+	int32_t y;
+	int32_t pressure;
+	int32_t tilt_x;
+	int32_t tilt_y;
+	int32_t distance;
+	int32_t wheel;
+	int32_t tool_id;	/* ABS_MISC, Wacom tool id */
+	uint32_t serial;	/* MSC_SERIAL */
+	uint16_t tool;		/* BTN_TOOL_* in proximity, 0 when out of proximity */
+	uint16_t buttons;	/* PEN_BUTTON_* */
+	uint32_t changed;	/* PEN_CHANGED_* since the previous frame */
+};
+
+struct pen_assembler {
+	int fd;			/* used to resync after SYN_DROPPED */
+	int dropped;		/* discarding events up to the next SYN_REPORT */
+	unsigned long nframes;
+	unsigned long nresyncs;
+	struct pen_frame state;
+};
+
+void pen_assembler_init(struct pen_assembler *pa, int fd);
+
+/* Feed one event. Returns 1 and fills in frame when ev completes a
+ * report, 0 otherwise.
+ */
+int pen_assembler_feed(struct pen_assembler *pa, const struct input_event *ev,
+		       struct pen_frame *frame);
+
+/* Read the full pen state back from the device */
+int pen_assembler_resync(struct pen_assembler *pa);
+
+const char *pen_tool_name(uint16_t tool);
+
+#endif /* PEN_FRAME_H */
@@ -1,56 +1,165 @@
 /* print stylus raw coordinates and pressure from kernel events for both tip and eraser
  *
  * to compile:
- *  gcc -o pressure pressure.c  
+ *  gcc -o pressure pressure.c pen-frame.c event-ring.c event-mask.c -lpthread
  *
  * to run:
  *  find your device in /dev/input/...
- *  sudo ./pressure /dev/input/eventX
+ *  sudo ./pressure [-q depth] /dev/input/eventX
  *
  * hint: compile and run devices.c first to find the
  * /dev/input/eventX that your pen is associated with
+ *
+ * Events are collected into one pen_frame per SYN_REPORT (see
+ * pen-frame.c), so each line shows the complete pen state at the time
+ * of the report instead of the single axis that changed.
+ *
+ * The device is read on its own thread straight into the slots of a
+ * ring (see event-ring.c) so a slow terminal can't hold up reading.
+ * Events lost to a full ring are handled like a SYN_DROPPED.
+ *
+ * Only position, pressure, the tool and BTN_TOUCH are printed, so the
+ * kernel is told with EVIOCSMASK (see event-mask.c) to keep the rest
+ * (tilt, serial numbers, side buttons, ...) out of our queue. Frames in
+ * which nothing we subscribed to changed don't wake us up at all.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <linux/input.h>
 
-int main (int argc, const char * argv[]) {
+#include "pen-frame.h"
+#include "event-ring.h"
+#include "event-mask.h"
 
-	int fd = -1;
-	size_t sz;
-	struct input_event events[128];
-	int i;
+struct reader {
+	int fd;
+	struct event_ring ring;
+};
 
-	if ((fd = open(argv[1], O_RDONLY)) < 0) {
-		perror("fd open error!");
-		exit(1);
-	}
+static void *reader_thread(void *data)
+{
+	struct reader *r = data;
+	struct input_event scratch[EVENT_RING_BATCH];
+	struct event_batch *batch;
+	ssize_t sz;
 
 	while (1) {
-		sz = read(fd, events, sizeof(struct input_event) * 128);
+		/* read straight into the next slot, or drop into scratch
+		 * if the ring is full so the kernel buffer keeps draining */
+		batch = event_ring_reserve(&r->ring);
+		sz = read(r->fd, batch ? batch->events : scratch,
+			  sizeof(struct input_event) * EVENT_RING_BATCH);
 
 		if (sz < (int) sizeof(struct input_event)) {
 			perror("size error!");
-			exit (1);
+			break;
+		}
+
+		if (!batch) {
+			event_ring_overflow(&r->ring, sz / sizeof(struct input_event));
+			continue;
+		}
+
+		batch->device = 0;
+		batch->count = sz / sizeof(struct input_event);
+		event_ring_commit(&r->ring);
+	}
+
+	event_ring_close(&r->ring);
+	return NULL;
+}
+
+static const struct event_code subscription[] = {
+	{ EV_ABS, ABS_X },
+	{ EV_ABS, ABS_Y },
+	{ EV_ABS, ABS_PRESSURE },
+	{ EV_KEY, BTN_TOUCH },
+	{ EV_KEY, BTN_TOOL_PEN },
+	{ EV_KEY, BTN_TOOL_RUBBER },
+	{ EV_KEY, BTN_TOOL_BRUSH },
+	{ EV_KEY, BTN_TOOL_PENCIL },
+	{ EV_KEY, BTN_TOOL_AIRBRUSH },
+	{ EV_KEY, BTN_TOOL_MOUSE },
+	{ EV_KEY, BTN_TOOL_LENS },
+};
+
+static void print_frame(const struct pen_frame *frame)
+{
+	if (frame->changed & PEN_CHANGED_RESYNC)
+		printf("SYN_DROPPED, state read back from the device\n");
+
+	if (!(frame->changed & (PEN_CHANGED_X | PEN_CHANGED_Y | PEN_CHANGED_PRESSURE)))
+		return;
+
+	printf("%-6s x value %6d\ty value %6d\tpressure value %4d\n",
+		pen_tool_name(frame->tool),
+		frame->x,
+		frame->y,
+		frame->pressure);
+}
+
+int main (int argc, char * argv[]) {
+
+	struct reader r;
+	struct event_batch *batch;
+	struct input_event dropped = { .type = EV_SYN, .code = SYN_DROPPED };
+	struct pen_assembler pa;
+	struct pen_frame frame;
+	struct event_mask mask;
+	pthread_t thread;
+	int depth = EVENT_RING_DEPTH;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "q:")) != -1) {
+		if (opt == 'q') {
+			depth = atoi(optarg);
+		} else {
+			fprintf(stderr, "Usage: %s [-q depth] /dev/input/eventX\n", argv[0]);
+			exit(1);
 		}
+	}
+
+	if (optind >= argc || (r.fd = open(argv[optind], O_RDONLY)) < 0) {
+		perror("fd open error!");
+		exit(1);
+	}
+
+	if (event_ring_init(&r.ring, depth > 0 ? depth : 1) < 0)
+		exit(1);
 
-		for (i = 0; i < (int) (sz / sizeof(struct input_event)); i++) {
+	/* not fatal: without the mask pen-frame.c ignores what we don't print */
+	event_mask_init(&mask);
+	event_mask_add_list(&mask, subscription,
+			    sizeof(subscription) / sizeof(subscription[0]));
+	if (event_mask_apply(&mask, r.fd) < 0)
+		perror("EVIOCSMASK, reading all events");
 
-			if (events[i].type != 3)
-				continue;
+	pen_assembler_init(&pa, r.fd);
+	pen_assembler_resync(&pa);
 
-			if (events[i].code == ABS_X)
-				printf("x value %d\n", events[i].value);
-			if (events[i].code == ABS_Y)
-				printf("\t\t\ty value %d\n", events[i].value);
-			if (events[i].code == ABS_PRESSURE)
-				printf("\t\t\t\t\t\tpressure value %d\n", events[i].value);
+	if (pthread_create(&thread, NULL, reader_thread, &r) != 0) {
+		fprintf(stderr, "failed to start the reader thread\n");
+		exit(1);
+	}
 
+	while ((batch = event_ring_peek(&r.ring))) {
+		/* lost events leave the state as unknown as SYN_DROPPED does */
+		if (batch->lost)
+			pen_assembler_feed(&pa, &dropped, &frame);
+
+		for (i = 0; i < batch->count; i++) {
+			if (pen_assembler_feed(&pa, &batch->events[i], &frame))
+				print_frame(&frame);
 		}
+
+		event_ring_release(&r.ring);
 	}
 
-	return 0;
+	pthread_join(thread, NULL);
+	event_ring_free(&r.ring);
+	return 1;
 }
@@ -0,0 +1,130 @@
+/* Real-time setup for a capture thread
+ *
+ * See realtime.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/input.h>
+
+#include "realtime.h"
+
+int rt_lock_memory(void)
+{
+	/* freed memory stays in the heap, large blocks don't get their
+	 * own mapping that would be unmapped and faulted in again */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		perror("mlockall");
+		return -1;
+	}
+
+	return 0;
+}
+
+void rt_prefault(void *buf, size_t size)
+{
+	volatile char *p = buf;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i = 0; i < size; i += page)
+		p[i] = p[i];
+	if (size)
+		p[size - 1] = p[size - 1];
+}
+
+static void prefault_stack(void)
+{
+	volatile char stack[RT_STACK_PREFAULT];
+
+	rt_prefault((char *) stack, sizeof(stack));
+}
+
+int rt_enter(int priority, int cpu)
+{
+	struct sched_param param;
+	int err;
+
+	if (cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (err) {
+			fprintf(stderr, "CPU %d: %s\n", cpu, strerror(err));
+			return -1;
+		}
+	}
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err) {
+		fprintf(stderr, "SCHED_FIFO %d: %s\n", priority, strerror(err));
+		return -1;
+	}
+
+	prefault_stack();
+	return 0;
+}
+
+void rt_deadline_init(struct rt_deadline *d, struct capture *cap, int budget_us)
+{
+	int clk = CLOCK_MONOTONIC;
+	int i;
+
+	d->budget_us = budget_us;
+	atomic_init(&d->reports, 0);
+	atomic_init(&d->missed, 0);
+	atomic_init(&d->worst_us, 0);
+
+	for (i = 0; i < cap->ndevices; i++)
+		if (cap->devices[i].fd >= 0 &&
+		    ioctl(cap->devices[i].fd, EVIOCSCLOCKID, &clk) < 0)
+			perror("EVIOCSCLOCKID");
+}
+
+void rt_deadline_check(struct rt_deadline *d, const struct input_event *events,
+		       int count)
+{
+	struct timespec ts;
+	int64_t now, late;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	for (i = 0; i < count; i++) {
+		const struct input_event *ev = &events[i];
+
+		if (ev->type != EV_SYN || ev->code != SYN_REPORT)
+			continue;
+
+		/* only this thread writes, so load + store is enough */
+		late = now - ((int64_t) ev->time.tv_sec * 1000000 + ev->time.tv_usec);
+		atomic_store_explicit(&d->reports,
+				      atomic_load_explicit(&d->reports, memory_order_relaxed) + 1,
+				      memory_order_relaxed);
+		if (late <= d->budget_us)
+			continue;
+
+		if (late > atomic_load_explicit(&d->worst_us, memory_order_relaxed))
+			atomic_store_explicit(&d->worst_us, late, memory_order_relaxed);
+		atomic_store_explicit(&d->missed,
+				      atomic_load_explicit(&d->missed, memory_order_relaxed) + 1,
+				      memory_order_release);
+	}
+}
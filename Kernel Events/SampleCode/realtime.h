@@ -0,0 +1,53 @@
+/* Real-time setup for a capture thread
+ *
+ * Page faults and preemption by other processes are what turns a busy
+ * machine into visible ink lag. rt_lock_memory() locks every present
+ * and future page of the process and stops malloc from giving memory
+ * back, rt_prefault() touches buffers so their first use doesn't fault,
+ * and rt_enter() moves the calling thread to SCHED_FIFO on one CPU and
+ * faults in its stack. All of it runs once at startup; the capture path
+ * itself must not allocate afterwards.
+ *
+ * struct rt_deadline counts reports that took longer than a budget from
+ * the kernel timestamp to the point they were handed on. It is updated
+ * by the capture thread only and read by any other thread, so the
+ * capture thread never prints.
+ */
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <linux/input.h>
+
+#include "capture.h"
+
+#define RT_STACK_PREFAULT	(256 * 1024)
+
+struct rt_deadline {
+	int64_t budget_us;
+	atomic_ulong reports;
+	atomic_ulong missed;
+	_Atomic int64_t worst_us;	/* slowest report so far */
+};
+
+/* mlockall() and no trimming of the malloc heap */
+int rt_lock_memory(void);
+
+/* Write to every page of buf */
+void rt_prefault(void *buf, size_t size);
+
+/* Call from the capture thread: SCHED_FIFO at priority, pinned to cpu
+ * unless cpu is -1, stack prefaulted */
+int rt_enter(int priority, int cpu);
+
+/* Switches the devices to CLOCK_MONOTONIC timestamps */
+void rt_deadline_init(struct rt_deadline *d, struct capture *cap, int budget_us);
+
+/* Call right after the read that returned events */
+void rt_deadline_check(struct rt_deadline *d, const struct input_event *events,
+		       int count);
+
+#endif /* REALTIME_H */
@@ -0,0 +1,469 @@
+/* Compact binary recording of kernel events
+ *
+ * See recording.h for the file format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+
+#include "recording.h"
+#include "caps.h"
+
+/* a frame is at most a few bytes per event plus its header */
+#define REC_MAX_FRAME_BYTES	(20 + REC_MAX_FRAME_EVENTS * 16)
+
+static inline uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+	return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t) v | 0x80;
+		v >>= 7;
+	}
+	*p++ = (uint8_t) v;
+	return p;
+}
+
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end,
+					uint64_t *v)
+{
+	uint64_t result = 0;
+	int shift;
+
+	for (shift = 0; shift < 64 && p < end; shift += 7) {
+		uint8_t b = *p++;
+
+		result |= (uint64_t) (b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*v = result;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/* Values that are sent as deltas, everything else is stored as is */
+static inline int32_t *rec_delta_slot(struct rec_state *state, int type, int code)
+{
+	if (type == EV_ABS && code < ABS_CNT)
+		return &state->abs[code];
+	if (type == EV_MSC && code == MSC_TIMESTAMP)
+		return &state->msc_timestamp;
+	return NULL;
+}
+
+static void rec_snapshot(struct rec_header *h, int devfd)
+{
+	struct device_caps caps;
+
+	caps_probe(devfd, &caps);
+
+	h->id = caps.id;
+	memcpy(h->name, caps.name, sizeof(h->name));
+	memcpy(h->props, caps.props, sizeof(h->props));
+	memcpy(h->bits, caps.bits, sizeof(h->bits));
+	memcpy(h->absinfo, caps.absinfo, sizeof(h->absinfo));
+}
+
+int rec_writer_open(struct rec_writer *w, const char *path, int devfd)
+{
+	memset(w, 0, sizeof(*w));
+
+	w->file = fopen(path, "wb");
+	if (!w->file) {
+		perror(path);
+		return -1;
+	}
+	setvbuf(w->file, NULL, _IOFBF, 1 << 20);
+
+	memcpy(w->header.magic, REC_MAGIC, sizeof(w->header.magic));
+	w->header.version = REC_VERSION;
+	w->header.index_interval = REC_INDEX_INTERVAL;
+	rec_snapshot(&w->header, devfd);
+
+	if (fwrite(&w->header, sizeof(w->header), 1, w->file) != 1) {
+		perror(path);
+		fclose(w->file);
+		return -1;
+	}
+	w->offset = sizeof(w->header);
+
+	return 0;
+}
+
+static int rec_add_index(struct rec_writer *w, uint64_t time_us)
+{
+	struct rec_index_entry *e;
+
+	if (w->header.nindex == w->index_size) {
+		uint64_t size = w->index_size ? w->index_size * 2 : 64;
+
+		e = realloc(w->index, size * sizeof(*e));
+		if (!e)
+			return -1;
+		w->index = e;
+		w->index_size = size;
+	}
+
+	e = &w->index[w->header.nindex++];
+	e->time_us = time_us;
+	e->offset = w->offset;
+	e->frame = w->header.nframes;
+	return 0;
+}
+
+static int rec_write_frame(struct rec_writer *w, int report,
+			   const struct timeval *time)
+{
+	uint8_t buf[REC_MAX_FRAME_BYTES];
+	uint8_t *p = buf;
+	uint64_t now = rec_time_us(time);
+	int i;
+
+	if (w->header.nframes % w->header.index_interval == 0) {
+		memset(&w->state, 0, sizeof(w->state));
+		if (rec_add_index(w, now) < 0)
+			return -1;
+	}
+	if (w->header.nframes == 0)
+		w->header.start_us = now;
+
+	p = put_varint(p, zigzag((int64_t) (now - w->state.prev_us)));
+	p = put_varint(p, ((uint64_t) w->npending << 1) | report);
+	w->state.prev_us = now;
+
+	for (i = 0; i < w->npending; i++) {
+		const struct input_event *ev = &w->pending[i];
+		int32_t *last = rec_delta_slot(&w->state, ev->type, ev->code);
+		int64_t value = ev->value;
+
+		if (last) {
+			value -= *last;
+			*last = ev->value;
+		}
+
+		*p++ = (uint8_t) ev->type;
+		p = put_varint(p, ev->code);
+		p = put_varint(p, zigzag(value));
+	}
+
+	if (fwrite(buf, p - buf, 1, w->file) != 1)
+		return -1;
+
+	w->offset += p - buf;
+	w->header.nframes++;
+	w->header.nevents += w->npending;
+	w->npending = 0;
+	return 0;
+}
+
+int rec_writer_add(struct rec_writer *w, const struct input_event *events,
+		   int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const struct input_event *ev = &events[i];
+
+		if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+			if (rec_write_frame(w, 1, &ev->time) < 0)
+				return -1;
+			continue;
+		}
+
+		w->pending[w->npending++] = *ev;
+		if (w->npending == REC_MAX_FRAME_EVENTS &&
+		    rec_write_frame(w, 0, &ev->time) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int rec_writer_close(struct rec_writer *w)
+{
+	int rc = 0;
+
+	if (w->npending)
+		rc = rec_write_frame(w, 0, &w->pending[w->npending - 1].time);
+
+	w->header.index_offset = w->offset;
+	if (rc == 0 && w->header.nindex &&
+	    fwrite(w->index, sizeof(*w->index), w->header.nindex, w->file) != w->header.nindex)
+		rc = -1;
+
+	/* the header is rewritten last, a crash before this leaves
+	 * index_offset at 0 and the reader rebuilds the index */
+	if (rc == 0 &&
+	    (fseek(w->file, 0, SEEK_SET) < 0 ||
+	     fwrite(&w->header, sizeof(w->header), 1, w->file) != 1))
+		rc = -1;
+
+	if (fclose(w->file) != 0)
+		rc = -1;
+	if (rc < 0)
+		perror("recording");
+
+	free(w->index);
+	w->index = NULL;
+	w->file = NULL;
+	return rc;
+}
+
+/* Decode one frame at r->pos, returns the number of events or -1 */
+static int rec_decode(struct rec_reader *r, struct input_event *events,
+		      int max, uint64_t *time_us)
+{
+	const uint8_t *p = r->pos;
+	struct timeval tv;
+	uint64_t v, n, time;
+	int i, count;
+
+	if (r->frame % r->header->index_interval == 0)
+		memset(&r->state, 0, sizeof(r->state));
+
+	if (!(p = get_varint(p, r->end, &v)))
+		return -1;
+	time = r->state.prev_us + unzigzag(v);
+
+	if (!(p = get_varint(p, r->end, &n)))
+		return -1;
+	count = n >> 1;
+	if (count > REC_MAX_FRAME_EVENTS || count + 1 > max)
+		return -1;
+
+	tv.tv_sec = time / 1000000;
+	tv.tv_usec = time % 1000000;
+
+	for (i = 0; i < count; i++) {
+		struct input_event *ev = &events[i];
+		uint64_t code, value;
+		int32_t *last;
+
+		if (p >= r->end)
+			return -1;
+		ev->type = *p++;
+		if (!(p = get_varint(p, r->end, &code)) ||
+		    !(p = get_varint(p, r->end, &value)))
+			return -1;
+
+		ev->time = tv;
+		ev->code = code;
+
+		last = rec_delta_slot(&r->state, ev->type, ev->code);
+		ev->value = (int32_t) (unzigzag(value) + (last ? *last : 0));
+		if (last)
+			*last = ev->value;
+	}
+
+	if (n & 1) {
+		events[count].time = tv;
+		events[count].type = EV_SYN;
+		events[count].code = SYN_REPORT;
+		events[count].value = 0;
+		count++;
+	}
+
+	r->state.prev_us = time;
+	r->pos = p;
+	r->frame++;
+	*time_us = time;
+	return count;
+}
+
+/* Recover the index of a recording that was not closed */
+static int rec_build_index(struct rec_reader *r)
+{
+	struct input_event events[REC_MAX_FRAME_EVENTS + 1];
+	uint64_t size = 0, time_us;
+	const uint8_t *start;
+
+	while (r->pos < r->end) {
+		start = r->pos;
+		if (r->frame % r->header->index_interval == 0 && r->nindex == size) {
+			struct rec_index_entry *e;
+
+			size = size ? size * 2 : 64;
+			e = realloc(r->built_index, size * sizeof(*e));
+			if (!e)
+				return -1;
+			r->built_index = e;
+		}
+
+		if (rec_decode(r, events, REC_MAX_FRAME_EVENTS + 1, &time_us) < 0) {
+			/* a torn frame at the end of an interrupted recording */
+			r->end = start;
+			break;
+		}
+
+		if ((r->frame - 1) % r->header->index_interval == 0) {
+			struct rec_index_entry *e = &r->built_index[r->nindex++];
+
+			e->time_us = time_us;
+			e->offset = start - r->map;
+			e->frame = r->frame - 1;
+		}
+	}
+
+	r->index = r->built_index;
+	return 0;
+}
+
+/* The index in the file must fit the mapping and point into the frames */
+static int rec_index_valid(const struct rec_reader *r)
+{
+	const struct rec_index_entry *index;
+	uint64_t offset = r->header->index_offset;
+	uint64_t i, n = r->header->nindex;
+
+	if (n > (r->size - offset) / sizeof(*index))
+		return 0;
+
+	index = (const struct rec_index_entry *) (r->map + offset);
+	for (i = 0; i < n; i++) {
+		if (index[i].offset < sizeof(struct rec_header) ||
+		    index[i].offset >= offset)
+			return 0;
+	}
+
+	return 1;
+}
+
+int rec_reader_open(struct rec_reader *r, const char *path)
+{
+	struct stat st;
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	if ((size_t) st.st_size < sizeof(struct rec_header)) {
+		fprintf(stderr, "%s: not a recording\n", path);
+		close(fd);
+		return -1;
+	}
+
+	r->size = st.st_size;
+	r->map = mmap(NULL, r->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (r->map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	madvise((void *) r->map, r->size, MADV_SEQUENTIAL);
+
+	r->header = (const struct rec_header *) r->map;
+	if (memcmp(r->header->magic, REC_MAGIC, sizeof(r->header->magic)) != 0 ||
+	    r->header->version != REC_VERSION ||
+	    r->header->index_interval == 0 ||
+	    r->header->index_offset > r->size) {
+		fprintf(stderr, "%s: not a recording\n", path);
+		rec_reader_close(r);
+		return -1;
+	}
+
+	r->pos = r->map + sizeof(struct rec_header);
+	if (r->header->index_offset >= sizeof(struct rec_header) &&
+	    rec_index_valid(r)) {
+		r->end = r->map + r->header->index_offset;
+		r->index = (const struct rec_index_entry *) r->end;
+		r->nindex = r->header->nindex;
+	} else {
+		if (r->header->index_offset)
+			fprintf(stderr, "%s: bad index, rebuilding it\n", path);
+		r->end = r->map + (r->header->index_offset >= sizeof(struct rec_header) ?
+				   r->header->index_offset : r->size);
+		if (rec_build_index(r) < 0) {
+			rec_reader_close(r);
+			return -1;
+		}
+		r->pos = r->map + sizeof(struct rec_header);
+		r->frame = 0;
+	}
+
+	return 0;
+}
+
+void rec_reader_close(struct rec_reader *r)
+{
+	if (r->map && r->map != MAP_FAILED)
+		munmap((void *) r->map, r->size);
+	free(r->built_index);
+	memset(r, 0, sizeof(*r));
+}
+
+int rec_reader_seek(struct rec_reader *r, uint64_t time_us)
+{
+	struct input_event events[REC_MAX_FRAME_EVENTS + 1];
+	uint64_t lo = 0, hi = r->nindex, frame_us;
+	const uint8_t *pos;
+	struct rec_state state;
+	uint64_t frame;
+
+	if (r->nindex == 0)
+		return 0;
+
+	/* last keyframe at or before time_us */
+	while (hi - lo > 1) {
+		uint64_t mid = (lo + hi) / 2;
+
+		if (r->index[mid].time_us <= time_us)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	r->pos = r->map + r->index[lo].offset;
+	r->frame = r->index[lo].frame;
+
+	/* then step forward frame by frame */
+	while (r->pos < r->end) {
+		pos = r->pos;
+		state = r->state;
+		frame = r->frame;
+
+		if (rec_decode(r, events, REC_MAX_FRAME_EVENTS + 1, &frame_us) < 0)
+			return -1;
+
+		if (frame_us >= time_us) {
+			r->pos = pos;
+			r->state = state;
+			r->frame = frame;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+int rec_reader_next(struct rec_reader *r, struct input_event *events, int max)
+{
+	uint64_t time_us;
+
+	if (r->pos >= r->end)
+		return 0;
+
+	return rec_decode(r, events, max, &time_us);
+}
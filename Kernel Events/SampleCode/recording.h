@@ -0,0 +1,126 @@
+/* Compact binary recording of kernel events
+ *
+ * File layout:
+ *
+ *   struct rec_header        device snapshot: name, id, properties,
+ *                            capability bitmaps and absinfo of all axes
+ *   frame records            one per SYN_REPORT, see below
+ *   struct rec_index_entry[] seek index, one entry every index_interval
+ *                            frames, written on rec_writer_close()
+ *
+ * A frame record is
+ *
+ *   varint   zigzag time delta in us to the previous frame
+ *   varint   (number of events << 1) | 1 if the frame ends in SYN_REPORT
+ *   per event:
+ *     u8     type
+ *     varint code
+ *     varint zigzag value, for EV_ABS and MSC_TIMESTAMP the delta to the
+ *            previous value of the same code
+ *
+ * The kernel gives all events of a report the same timestamp, so only
+ * one time per frame is stored. Every index_interval frames a keyframe
+ * starts: its time and all value deltas are relative to zero, so
+ * decoding can start at any index entry.
+ *
+ * Capability bitmaps are stored as EVIOCGBIT returns them, which is the
+ * byte order of the recording host.
+ */
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+#include "caps.h"
+
+#define REC_MAGIC		"WACOMREC"
+#define REC_VERSION		1
+#define REC_INDEX_INTERVAL	1024
+#define REC_BITS_SIZE		CAPS_BITS_SIZE
+#define REC_MAX_FRAME_EVENTS	256
+
+struct rec_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t index_interval;
+	uint64_t start_us;	/* time of the first frame */
+	uint64_t index_offset;	/* 0 if the recording was not closed cleanly */
+	uint64_t nindex;
+	uint64_t nframes;
+	uint64_t nevents;
+	struct input_id id;
+	char name[256];
+	uint8_t props[INPUT_PROP_CNT / 8];
+	uint8_t reserved[4];
+	uint8_t bits[EV_CNT][REC_BITS_SIZE];
+	struct input_absinfo absinfo[ABS_CNT];
+};
+
+struct rec_index_entry {
+	uint64_t time_us;
+	uint64_t offset;
+	uint64_t frame;
+};
+
+struct rec_state {
+	uint64_t prev_us;
+	int32_t abs[ABS_CNT];
+	int32_t msc_timestamp;
+};
+
+struct rec_writer {
+	FILE *file;
+	uint64_t offset;
+	struct rec_header header;
+	struct rec_state state;
+	struct input_event pending[REC_MAX_FRAME_EVENTS];
+	int npending;
+	struct rec_index_entry *index;
+	uint64_t index_size;
+};
+
+struct rec_reader {
+	const uint8_t *map;
+	size_t size;
+	const struct rec_header *header;
+	const struct rec_index_entry *index;
+	uint64_t nindex;
+	struct rec_index_entry *built_index;	/* if the file has none */
+	const uint8_t *pos;
+	const uint8_t *end;
+	uint64_t frame;
+	struct rec_state state;
+};
+
+static inline uint64_t rec_time_us(const struct timeval *tv)
+{
+	return (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* Snapshot the device behind devfd and start a recording */
+int rec_writer_open(struct rec_writer *w, const char *path, int devfd);
+
+/* Append events, frames are written as their SYN_REPORT arrives */
+int rec_writer_add(struct rec_writer *w, const struct input_event *events,
+		   int count);
+
+/* Flush, write the seek index and patch the header */
+int rec_writer_close(struct rec_writer *w);
+
+/* mmap a recording, building the seek index if it has none */
+int rec_reader_open(struct rec_reader *r, const char *path);
+void rec_reader_close(struct rec_reader *r);
+
+/* Position the reader on the first frame at or after time_us */
+int rec_reader_seek(struct rec_reader *r, uint64_t time_us);
+
+/* Decode the next frame into events, SYN_REPORT included. max must be
+ * at least REC_MAX_FRAME_EVENTS + 1. Returns the number of events, 0 at
+ * the end of the recording or -1 if the data is corrupt.
+ */
+int rec_reader_next(struct rec_reader *r, struct input_event *events, int max);
+
+#endif /* RECORDING_H */
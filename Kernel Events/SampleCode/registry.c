@@ -0,0 +1,279 @@
+/* Hotplug aware registry of /dev/input/event* nodes
+ *
+ * See registry.h. inotify and the kernel uevent both report most
+ * changes, whichever comes second finds the node already in the
+ * registry and is ignored. inotify also reports IN_ATTRIB when udev
+ * fixes up the permissions of a new node, which is when a node that
+ * could not be opened on creation is probed again.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/input.h>
+
+#include "registry.h"
+
+#define INPUT_DIR	"/dev/input"
+
+/* "eventN" -> N, -1 for anything else */
+static int node_number(const char *name)
+{
+	char *end;
+	long n;
+
+	if (strncmp("event", name, 5) != 0 || !name[5])
+		return -1;
+
+	n = strtol(name + 5, &end, 10);
+	if (*end || n < 0 || n >= REGISTRY_MAX_NODES)
+		return -1;
+
+	return n;
+}
+
+static void registry_probe(struct registry *reg, int number)
+{
+	struct registry_device *dev = reg->nodes[number];
+	int fd;
+
+	if (dev && dev->state != REGISTRY_FAILED)
+		return;		/* already known, second notification */
+
+	if (!dev) {
+		dev = calloc(1, sizeof(*dev));
+		if (!dev) {
+			perror("calloc");
+			return;
+		}
+		dev->number = number;
+		snprintf(dev->path, sizeof(dev->path), INPUT_DIR "/event%d", number);
+		reg->nodes[number] = dev;
+	}
+
+	fd = open(dev->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		/* report each new reason once; ENOENT only means the
+		 * uevent was faster than the device node */
+		if (errno != ENOENT && errno != dev->error)
+			fprintf(stderr, "%s: %s\n", dev->path, strerror(errno));
+		dev->error = errno;
+		dev->state = REGISTRY_FAILED;
+		return;
+	}
+
+	strcpy(dev->name, "???");
+	ioctl(fd, EVIOCGNAME(sizeof(dev->name)), dev->name);
+	ioctl(fd, EVIOCGID, &dev->id);
+	close(fd);
+
+	dev->error = 0;
+	if (reg->wacom_only && strncmp("Wacom", dev->name, 5) != 0) {
+		dev->state = REGISTRY_IGNORED;
+		return;
+	}
+
+	dev->state = REGISTRY_PRESENT;
+	reg->npresent++;
+	if (reg->added)
+		reg->added(reg, dev, reg->data);
+}
+
+static void registry_remove(struct registry *reg, int number)
+{
+	struct registry_device *dev = reg->nodes[number];
+
+	if (!dev)
+		return;
+
+	if (dev->state == REGISTRY_PRESENT) {
+		reg->npresent--;
+		if (reg->removed)
+			reg->removed(reg, dev, reg->data);
+	}
+
+	reg->nodes[number] = NULL;
+	free(dev);
+}
+
+static int is_event_device(const struct dirent *dir) {
+	return node_number(dir->d_name) >= 0;
+}
+
+/* Probe every node in /dev/input and forget the ones that are gone,
+ * on startup and whenever notifications were lost */
+static void registry_scan(struct registry *reg)
+{
+	char seen[REGISTRY_MAX_NODES] = { 0 };
+	struct dirent **namelist;
+	int i, n, ndev;
+
+	ndev = scandir(INPUT_DIR, &namelist, is_event_device, versionsort);
+	if (ndev < 0) {
+		perror(INPUT_DIR);
+		return;
+	}
+
+	for (i = 0; i < ndev; i++) {
+		n = node_number(namelist[i]->d_name);
+		seen[n] = 1;
+		registry_probe(reg, n);
+		free(namelist[i]);
+	}
+	free(namelist);
+
+	for (n = 0; n < REGISTRY_MAX_NODES; n++)
+		if (reg->nodes[n] && !seen[n])
+			registry_remove(reg, n);
+}
+
+static int open_uevent_socket(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* kernel uevents, not the udev ones */
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int registry_init(struct registry *reg, int wacom_only,
+		  registry_func added, registry_func removed, void *data)
+{
+	memset(reg, 0, sizeof(*reg));
+	reg->wacom_only = wacom_only;
+	reg->added = added;
+	reg->removed = removed;
+	reg->data = data;
+
+	/* watch before scanning so nothing slips in between */
+	reg->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (reg->inotify_fd < 0 ||
+	    inotify_add_watch(reg->inotify_fd, INPUT_DIR,
+			      IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+		perror("inotify " INPUT_DIR);
+		if (reg->inotify_fd >= 0)
+			close(reg->inotify_fd);
+		return -1;
+	}
+
+	reg->uevent_fd = open_uevent_socket();
+	if (reg->uevent_fd < 0)
+		perror("uevent socket, relying on inotify");
+
+	registry_scan(reg);
+	return 0;
+}
+
+void registry_close(struct registry *reg)
+{
+	int i;
+
+	for (i = 0; i < REGISTRY_MAX_NODES; i++) {
+		free(reg->nodes[i]);
+		reg->nodes[i] = NULL;
+	}
+
+	close(reg->inotify_fd);
+	if (reg->uevent_fd >= 0)
+		close(reg->uevent_fd);
+}
+
+/* Returns 1 if the queue overflowed and events were lost */
+static int registry_read_inotify(struct registry *reg)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *p;
+	int n, lost = 0;
+
+	while ((len = read(reg->inotify_fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *) p;
+			if (ev->mask & IN_Q_OVERFLOW)
+				lost = 1;
+			if (!ev->len || (n = node_number(ev->name)) < 0)
+				continue;
+
+			if (ev->mask & IN_DELETE)
+				registry_remove(reg, n);
+			else
+				registry_probe(reg, n);
+		}
+	}
+
+	return lost;
+}
+
+/* Returns 1 if the socket buffer overflowed and uevents were lost */
+static int registry_read_uevent(struct registry *reg)
+{
+	char buf[8192];
+	ssize_t len;
+
+	while ((len = recv(reg->uevent_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		const char *action = NULL, *subsystem = NULL, *devname = NULL;
+		char *p;
+		int n;
+
+		/* "ACTION@DEVPATH\0KEY=VALUE\0KEY=VALUE\0..." */
+		buf[len] = '\0';
+		for (p = buf; p < buf + len; p += strlen(p) + 1) {
+			if (strncmp(p, "ACTION=", 7) == 0)
+				action = p + 7;
+			else if (strncmp(p, "SUBSYSTEM=", 10) == 0)
+				subsystem = p + 10;
+			else if (strncmp(p, "DEVNAME=", 8) == 0)
+				devname = p + 8;
+		}
+
+		if (!action || !subsystem || !devname ||
+		    strcmp(subsystem, "input") != 0 ||
+		    strncmp(devname, "input/", 6) != 0 ||
+		    (n = node_number(devname + 6)) < 0)
+			continue;
+
+		if (strcmp(action, "add") == 0)
+			registry_probe(reg, n);
+		else if (strcmp(action, "remove") == 0)
+			registry_remove(reg, n);
+	}
+
+	return len < 0 && errno == ENOBUFS;
+}
+
+int registry_dispatch(struct registry *reg)
+{
+	int lost;
+
+	lost = registry_read_inotify(reg);
+	if (reg->uevent_fd >= 0)
+		lost |= registry_read_uevent(reg);
+
+	/* whatever was missed, /dev/input is the truth */
+	if (lost)
+		registry_scan(reg);
+
+	return reg->npresent;
+}
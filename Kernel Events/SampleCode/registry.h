@@ -0,0 +1,64 @@
+/* Hotplug aware registry of /dev/input/event* nodes
+ *
+ * /dev/input is scanned once. After that the registry only probes
+ * nodes that inotify or a kernel uevent (NETLINK_KOBJECT_UEVENT)
+ * reports as added, and forgets nodes reported as removed, calling the
+ * added/removed callbacks for each change. Nodes are keyed by their
+ * event number, so handling a change doesn't depend on how many other
+ * nodes exist. If the inotify queue or the netlink socket overflows,
+ * /dev/input is scanned again and nodes that are gone are removed.
+ *
+ * Poll inotify_fd and uevent_fd (the latter is -1 if the netlink
+ * socket isn't available) for POLLIN and call registry_dispatch().
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <linux/input.h>
+
+#define REGISTRY_MAX_NODES	1024	/* highest eventN tracked + 1 */
+
+enum registry_state {
+	REGISTRY_PRESENT,	/* probed and reported with added() */
+	REGISTRY_IGNORED,	/* probed, not a Wacom node */
+	REGISTRY_FAILED,	/* could not be opened (yet) */
+};
+
+struct registry_device {
+	int number;		/* N of /dev/input/eventN */
+	enum registry_state state;
+	int error;		/* errno of the last failed open */
+	char path[32];
+	char name[256];
+	struct input_id id;
+};
+
+struct registry;
+
+typedef void (*registry_func)(struct registry *reg,
+			      const struct registry_device *dev, void *data);
+
+struct registry {
+	int inotify_fd;
+	int uevent_fd;
+	int wacom_only;
+	int npresent;
+	registry_func added;
+	registry_func removed;
+	void *data;
+	struct registry_device *nodes[REGISTRY_MAX_NODES];
+};
+
+/* Set up the watches, then scan /dev/input once calling added() for
+ * every node found. With wacom_only, only nodes named "Wacom..." are
+ * reported.
+ */
+int registry_init(struct registry *reg, int wacom_only,
+		  registry_func added, registry_func removed, void *data);
+void registry_close(struct registry *reg);
+
+/* Handle whatever inotify and netlink have queued, never blocks */
+int registry_dispatch(struct registry *reg);
+
+#endif /* REGISTRY_H */
@@ -19,11 +19,19 @@
  * List supported kernel event types for a device.
  *
  * to compile:
- *  gcc -o supported-event-types supported-event-types.c
+ *  gcc -o supported-event-types supported-event-types.c caps.c
  *
  * to run:
  *  sudo ./supported-event-types /dev/input/eventX
  *
+ *  or ask the device directly, bypassing the capability cache:
+ *  sudo ./supported-event-types -n /dev/input/eventX
+ *
+ * The capabilities come from caps.c, which keeps a snapshot per device
+ * in CAPS_CACHE_PATH. On later runs only the device identity is read
+ * from the kernel; the cached axis values are stale, so only the
+ * ranges are shown then.
+ *
  * Excerpted and modified from evtest.c by Aaron Armstrong Skomra @Wacom
  *
  * To get a graphic view of the multi-touch kernel events, please refer to:
@@ -36,25 +44,19 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/input.h>
-#include <sys/ioctl.h>
 #include <string.h>
 
-#define BITS_PER_LONG (sizeof(long) * 8)
-#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
-#define OFF(x)  ((x)%BITS_PER_LONG)
-#define BIT(x)  (1UL<<OFF(x))
-#define LONG(x) ((x)/BITS_PER_LONG)
-#define test_bit(bit, array)	((array[LONG(bit)] >> OFF(bit)) & 1)
+#include "caps.h"
 
 static const char * const absval[6] = { "Value", "Min  ", "Max  ", "Fuzz ", "Flat ", "Resolution "};
 
-static void print_absdata(int fd, int axis)
+static void print_absdata(const struct input_absinfo *absinfo, int cached)
 {
-	int abs[6] = {0};
+	int abs[6];
 	int k;
 
-	ioctl(fd, EVIOCGABS(axis), abs);
-	for (k = 0; k < 6; k++)
+	memcpy(abs, absinfo, sizeof(abs));
+	for (k = cached ? 1 : 0; k < 6; k++)
 		if ((k < 3) || abs[k])
 			printf("			%s %6d\n", absval[k], abs[k]);
 }
@@ -62,36 +64,42 @@ static void print_absdata(int fd, int axis)
 int main (int argc, const char * argv[]) {
 
 	int fd = -1;
-	unsigned long bit[EV_MAX][NBITS(KEY_MAX)];
+	struct device_caps caps;
 	unsigned int type, code;
-	char evtype_b[512]  = "";
+	int use_cache = 1;
+	int rc;
 
-	memset(bit, 0, sizeof(bit));
+	if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		use_cache = 0;
+		argv++;
+	}
 
 	if ((fd = open(argv[1], O_RDONLY)) < 0) {
 		perror("evdev open");
 		exit(1);
 	}
 
-	memset(evtype_b, 0, sizeof(evtype_b));
-	if (ioctl(fd, EVIOCGBIT(0, EV_MAX), evtype_b) < 0) {
+	rc = use_cache ? caps_load(fd, &caps, CAPS_CACHE_PATH) : caps_probe(fd, &caps);
+	if (rc < 0) {
 		perror("ioctl error");
+		exit(1);
 	}
-
-	ioctl(fd, EVIOCGBIT(0, EV_MAX), bit[0]);
+	if (rc == CAPS_HIT)
+		fprintf(stderr, "capabilities from cache %s\n", CAPS_CACHE_PATH);
+	else if (rc == CAPS_STORED)
+		fprintf(stderr, "capabilities stored in %s\n", CAPS_CACHE_PATH);
 
 	for (type = 0; type < EV_MAX; type++) {
-		if (test_bit(type, bit[0]) && type != EV_REP) {
+		if (caps_test_bit(caps.bits[0], type) && type != EV_REP) {
 
 			printf("  Events of type %d\n", type);
 			if (type == EV_SYN)
 				continue;
-			ioctl(fd, EVIOCGBIT(type, KEY_MAX), bit[type]);
 			for (code = 0; code < KEY_MAX; code++)
-				if (test_bit(code, bit[type])) {
+				if (caps_test_bit(caps.bits[type], code)) {
 					printf("		Event code %d\n", code);
 					if (type == EV_ABS)
-						print_absdata(fd, code);
+						print_absdata(&caps.absinfo[code], rc == CAPS_HIT);
 				}
 		}
 	}
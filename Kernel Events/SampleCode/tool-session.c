@@ -0,0 +1,218 @@
+/* Split pen frames into tool proximity sessions and contact strokes
+ *
+ * See tool-session.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tool-session.h"
+
+/* session_tracker.stroke while BTN_TOUCH is down but there was no room
+ * for the stroke record */
+#define STROKE_LOST	-2
+
+static inline uint64_t frame_us(const struct pen_frame *f)
+{
+	return (uint64_t) f->time.tv_sec * 1000000 + f->time.tv_usec;
+}
+
+int session_tracker_init(struct session_tracker *st, uint32_t max_sessions,
+			 uint32_t max_strokes, uint32_t max_frames)
+{
+	memset(st, 0, sizeof(*st));
+	st->current = -1;
+	st->stroke = -1;
+
+	st->sessions = calloc(max_sessions, sizeof(*st->sessions));
+	st->strokes = calloc(max_strokes, sizeof(*st->strokes));
+	st->frames = calloc(max_frames, sizeof(*st->frames));
+	if (!st->sessions || !st->strokes || !st->frames) {
+		perror("calloc");
+		session_tracker_free(st);
+		return -1;
+	}
+
+	st->max_sessions = max_sessions;
+	st->max_strokes = max_strokes;
+	st->max_frames = max_frames;
+	return 0;
+}
+
+void session_tracker_free(struct session_tracker *st)
+{
+	free(st->sessions);
+	free(st->strokes);
+	free(st->frames);
+	st->sessions = NULL;
+	st->strokes = NULL;
+	st->frames = NULL;
+}
+
+static void end_stroke(struct session_tracker *st, struct tool_session *s,
+		       uint64_t t)
+{
+	if (st->stroke >= 0) {
+		struct tool_stroke *k = &st->strokes[st->stroke];
+
+		k->end_us = t;
+		s->contact_us += t - k->start_us;
+	}
+	st->stroke = -1;
+}
+
+static struct tool_session *end_session(struct session_tracker *st)
+{
+	struct tool_session *s = &st->sessions[st->current];
+
+	end_stroke(st, s, s->end_us);
+	s->flags &= ~SESSION_OPEN;
+	st->current = -1;
+	return s;
+}
+
+static void start_session(struct session_tracker *st, const struct pen_frame *f)
+{
+	struct tool_session *s;
+
+	if (st->nsessions == st->max_sessions) {
+		st->lost_sessions++;
+		return;
+	}
+
+	st->current = st->nsessions++;
+	s = &st->sessions[st->current];
+	memset(s, 0, sizeof(*s));
+	s->start_us = frame_us(f);
+	s->tool = f->tool;
+	s->tool_id = f->tool_id;
+	/* the serial of a frame without MSC_SERIAL is left from the
+	 * previous tool */
+	s->serial = f->changed & PEN_CHANGED_SERIAL ? f->serial : 0;
+	s->flags = SESSION_OPEN;
+	s->first_frame = st->nframes;
+	s->first_stroke = st->nstrokes;
+}
+
+/* Does f belong to another tool than the open session? */
+static int tool_changed(struct tool_session *s, const struct pen_frame *f)
+{
+	if (f->tool != s->tool)
+		return 1;
+
+	if (f->changed & PEN_CHANGED_SERIAL && f->serial != s->serial) {
+		if (s->serial)
+			return 1;
+		/* the first MSC_SERIAL came a frame late */
+		s->serial = f->serial;
+	}
+
+	if (f->changed & PEN_CHANGED_TOOL && !s->tool_id)
+		s->tool_id = f->tool_id;
+
+	return 0;
+}
+
+const struct tool_session *session_tracker_feed(struct session_tracker *st,
+						const struct pen_frame *f)
+{
+	const struct tool_session *closed = NULL;
+	struct tool_session *s;
+	uint64_t t = frame_us(f);
+	int stored = 0;
+
+	if (st->current >= 0 && tool_changed(&st->sessions[st->current], f))
+		closed = end_session(st);
+
+	/* only count a lost session once, not for each of its frames */
+	if (st->current < 0 && f->tool && (closed || f->tool != st->last_tool))
+		start_session(st, f);
+	st->last_tool = f->tool;
+
+	if (st->current < 0)
+		return closed;
+	s = &st->sessions[st->current];
+
+	if (st->nframes < st->max_frames) {
+		st->frames[st->nframes++] = *f;
+		s->nframes++;
+		stored = 1;
+	} else {
+		st->lost_frames++;
+		s->flags |= SESSION_TRUNCATED;
+	}
+	s->end_us = t;
+
+	if (f->buttons & PEN_BUTTON_TOUCH && st->stroke == -1) {
+		if (st->nstrokes < st->max_strokes) {
+			struct tool_stroke *k;
+
+			st->stroke = st->nstrokes++;
+			k = &st->strokes[st->stroke];
+			memset(k, 0, sizeof(*k));
+			k->start_us = t;
+			k->first_frame = st->nframes - stored;
+			s->nstrokes++;
+		} else {
+			st->stroke = STROKE_LOST;
+			st->lost_strokes++;
+			s->flags |= SESSION_TRUNCATED;
+		}
+	}
+
+	if (st->stroke >= 0) {
+		struct tool_stroke *k = &st->strokes[st->stroke];
+
+		k->nframes += stored;
+		if (f->pressure > k->max_pressure)
+			k->max_pressure = f->pressure;
+	}
+
+	/* the frame with BTN_TOUCH up is the last one of its stroke */
+	if (!(f->buttons & PEN_BUTTON_TOUCH) && st->stroke != -1)
+		end_stroke(st, s, t);
+
+	return closed;
+}
+
+const struct tool_session *session_tracker_close(struct session_tracker *st)
+{
+	if (st->current < 0)
+		return NULL;
+
+	st->last_tool = 0;
+	return end_session(st);
+}
+
+void session_tracker_reset(struct session_tracker *st)
+{
+	struct tool_session *s;
+	uint32_t i;
+
+	if (st->current < 0) {
+		st->nsessions = 0;
+		st->nstrokes = 0;
+		st->nframes = 0;
+		return;
+	}
+
+	s = &st->sessions[st->current];
+
+	memmove(st->frames, &st->frames[s->first_frame],
+		s->nframes * sizeof(*st->frames));
+	memmove(st->strokes, &st->strokes[s->first_stroke],
+		s->nstrokes * sizeof(*st->strokes));
+	for (i = 0; i < s->nstrokes; i++)
+		st->strokes[i].first_frame -= s->first_frame;
+	if (st->stroke >= 0)
+		st->stroke -= s->first_stroke;
+
+	st->sessions[0] = *s;
+	st->sessions[0].first_frame = 0;
+	st->sessions[0].first_stroke = 0;
+	st->current = 0;
+	st->nsessions = 1;
+	st->nstrokes = st->sessions[0].nstrokes;
+	st->nframes = st->sessions[0].nframes;
+}
@@ -0,0 +1,93 @@
+/* Split pen frames into tool proximity sessions and contact strokes
+ *
+ * A session starts when a tool comes into proximity and ends when it
+ * leaves, or when another tool (BTN_TOOL_*) or another pen (MSC_SERIAL)
+ * takes its place without a frame out of proximity in between. Inside
+ * a session every BTN_TOUCH down..up is a stroke.
+ *
+ * Sessions, strokes and the frames they refer to are kept in arrays
+ * allocated once in session_tracker_init(). Frames of a session are
+ * consecutive in the frame arena, as are the frames of a stroke, so a
+ * record only carries an index and a count. When an array is full new
+ * records are counted as lost rather than grown; session_tracker_reset()
+ * makes room again once the closed sessions have been handled.
+ */
+
+#ifndef TOOL_SESSION_H
+#define TOOL_SESSION_H
+
+#include <stdint.h>
+
+#include "pen-frame.h"
+
+/* tool_session.flags */
+#define SESSION_OPEN		(1 << 0)	/* tool still in proximity */
+#define SESSION_TRUNCATED	(1 << 1)	/* frames or strokes were lost */
+
+struct tool_stroke {
+	uint64_t start_us;	/* frame with BTN_TOUCH down */
+	uint64_t end_us;	/* frame with BTN_TOUCH up */
+	uint32_t first_frame;	/* index into session_tracker.frames */
+	uint32_t nframes;
+	int32_t max_pressure;
+};
+
+struct tool_session {
+	uint64_t start_us;
+	uint64_t end_us;	/* last frame in proximity */
+	uint32_t serial;	/* MSC_SERIAL, 0 if the tablet sends none */
+	int32_t tool_id;	/* ABS_MISC */
+	uint16_t tool;		/* BTN_TOOL_* */
+	uint16_t flags;		/* SESSION_* */
+	uint32_t first_frame;	/* index into session_tracker.frames */
+	uint32_t nframes;	/* frames in the arena */
+	uint32_t first_stroke;	/* index into session_tracker.strokes */
+	uint32_t nstrokes;
+	uint64_t contact_us;	/* sum of the stroke durations */
+};
+
+struct session_tracker {
+	struct pen_frame *frames;
+	struct tool_stroke *strokes;
+	struct tool_session *sessions;
+	uint32_t max_frames, max_strokes, max_sessions;
+	uint32_t nframes, nstrokes, nsessions;
+	int current;		/* open session, -1 if none */
+	int stroke;		/* open stroke, -1 if none */
+	uint16_t last_tool;	/* tool of the previous frame */
+	unsigned long lost_frames;
+	unsigned long lost_strokes;
+	unsigned long lost_sessions;
+};
+
+int session_tracker_init(struct session_tracker *st, uint32_t max_sessions,
+			 uint32_t max_strokes, uint32_t max_frames);
+void session_tracker_free(struct session_tracker *st);
+
+/* Feed one frame. Returns the session this frame closed, or NULL. The
+ * pointer is valid up to the next session_tracker_reset().
+ */
+const struct tool_session *session_tracker_feed(struct session_tracker *st,
+						const struct pen_frame *frame);
+
+/* Close the open session, e.g. at the end of a recording */
+const struct tool_session *session_tracker_close(struct session_tracker *st);
+
+/* Drop all closed sessions with their strokes and frames. The open
+ * session, if any, is moved to the start of the arrays.
+ */
+void session_tracker_reset(struct session_tracker *st);
+
+static inline const struct pen_frame *
+session_frames(const struct session_tracker *st, const struct tool_session *s)
+{
+	return &st->frames[s->first_frame];
+}
+
+static inline const struct tool_stroke *
+session_strokes(const struct session_tracker *st, const struct tool_session *s)
+{
+	return &st->strokes[s->first_stroke];
+}
+
+#endif /* TOOL_SESSION_H */
@@ -0,0 +1,251 @@
+/* Print which tools were used, for how long and with how many strokes
+ *
+ * to compile:
+ *  gcc -o tool-sessions tool-sessions.c tool-session.c pen-frame.c \
+ *      recording.c caps.c
+ *
+ * to run:
+ *  find your pen device in /dev/input/...
+ *  sudo ./tool-sessions /dev/input/eventX
+ *
+ *  or go through a recording made with event-log -w:
+ *  ./tool-sessions -r capture.rec
+ *
+ *  and list every stroke, not just the sessions:
+ *  ./tool-sessions -v -r capture.rec
+ *
+ * A line is printed for every proximity session as it ends, and a table
+ * per tool (BTN_TOOL_* and MSC_SERIAL) on exit or Ctrl-C. The table is
+ * built from the session records of tool-session.c, so no event is
+ * looked at twice.
+ *
+ * hint: compile and run devices.c first to find the /dev/input/eventX
+ * that your pen is associated with
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+#include "pen-frame.h"
+#include "recording.h"
+#include "tool-session.h"
+
+#define MAX_SESSIONS	1024
+#define MAX_STROKES	16384
+#define MAX_FRAMES	(1 << 18)	/* 16 minutes in proximity at 266Hz */
+#define MAX_TOOLS	32
+
+struct tool_total {
+	uint16_t tool;
+	uint32_t serial;
+	int32_t tool_id;
+	unsigned long sessions;
+	unsigned long strokes;
+	unsigned long frames;
+	uint64_t prox_us;
+	uint64_t contact_us;
+};
+
+static struct tool_total totals[MAX_TOOLS];
+static int ntotals;
+static int verbose;
+static volatile sig_atomic_t running = 1;
+
+static void sighandler(int signal)
+{
+	running = 0;
+}
+
+static void add_total(const struct tool_session *s)
+{
+	struct tool_total *t;
+	int i;
+
+	for (i = 0; i < ntotals; i++)
+		if (totals[i].tool == s->tool && totals[i].serial == s->serial)
+			break;
+
+	if (i == ntotals) {
+		if (ntotals == MAX_TOOLS)
+			return;
+		t = &totals[ntotals++];
+		memset(t, 0, sizeof(*t));
+		t->tool = s->tool;
+		t->serial = s->serial;
+	}
+
+	t = &totals[i];
+	if (s->tool_id)
+		t->tool_id = s->tool_id;
+	t->sessions++;
+	t->strokes += s->nstrokes;
+	t->frames += s->nframes;
+	t->prox_us += s->end_us - s->start_us;
+	t->contact_us += s->contact_us;
+}
+
+static void print_session(const struct session_tracker *st,
+			  const struct tool_session *s)
+{
+	const struct tool_stroke *k = session_strokes(st, s);
+	uint32_t i;
+
+	printf("%llu.%06llu %-8s serial 0x%08x tool id 0x%06x %8.3fs %5u frames %4u strokes %8.3fs in contact%s\n",
+	       (unsigned long long) s->start_us / 1000000,
+	       (unsigned long long) s->start_us % 1000000,
+	       pen_tool_name(s->tool), s->serial, s->tool_id,
+	       (s->end_us - s->start_us) / 1e6, s->nframes, s->nstrokes,
+	       s->contact_us / 1e6,
+	       s->flags & SESSION_TRUNCATED ? " (truncated)" : "");
+
+	if (!verbose)
+		return;
+
+	for (i = 0; i < s->nstrokes; i++)
+		printf("\tstroke %3u +%8.3fs %8.3fs %5u frames max pressure %d\n",
+		       i, (k[i].start_us - s->start_us) / 1e6,
+		       (k[i].end_us - k[i].start_us) / 1e6,
+		       k[i].nframes, k[i].max_pressure);
+}
+
+static void session_done(struct session_tracker *st, const struct tool_session *s)
+{
+	print_session(st, s);
+	add_total(s);
+	fflush(stdout);
+
+	/* the records have been used, make room before the arrays fill */
+	if (st->nframes > st->max_frames / 2 || st->nsessions == st->max_sessions ||
+	    st->nstrokes > st->max_strokes / 2)
+		session_tracker_reset(st);
+}
+
+static void feed(struct session_tracker *st, struct pen_assembler *pa,
+		 const struct input_event *events, int count)
+{
+	const struct tool_session *s;
+	struct pen_frame frame;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!pen_assembler_feed(pa, &events[i], &frame))
+			continue;
+		s = session_tracker_feed(st, &frame);
+		if (s)
+			session_done(st, s);
+	}
+}
+
+static void print_totals(const struct session_tracker *st)
+{
+	int i;
+
+	printf("\n%-8s %-10s %-8s %8s %8s %10s %10s %10s\n", "tool", "serial",
+	       "tool id", "sessions", "strokes", "frames", "prox s", "contact s");
+
+	for (i = 0; i < ntotals; i++)
+		printf("%-8s 0x%08x 0x%06x %8lu %8lu %10lu %10.3f %10.3f\n",
+		       pen_tool_name(totals[i].tool), totals[i].serial,
+		       totals[i].tool_id, totals[i].sessions, totals[i].strokes,
+		       totals[i].frames, totals[i].prox_us / 1e6,
+		       totals[i].contact_us / 1e6);
+
+	if (st->lost_sessions || st->lost_strokes || st->lost_frames)
+		printf("lost: %lu sessions, %lu strokes, %lu frames\n",
+		       st->lost_sessions, st->lost_strokes, st->lost_frames);
+}
+
+static int read_recording(struct session_tracker *st, const char *path)
+{
+	struct input_event events[REC_MAX_FRAME_EVENTS + 1];
+	struct pen_assembler pa;
+	struct rec_reader rec;
+	int count = 0;
+
+	if (rec_reader_open(&rec, path) < 0)
+		return -1;
+
+	/* a recording has no SYN_DROPPED, the assembler never resyncs */
+	pen_assembler_init(&pa, -1);
+	while (running && (count = rec_reader_next(&rec, events, REC_MAX_FRAME_EVENTS + 1)) > 0)
+		feed(st, &pa, events, count);
+
+	if (count < 0)
+		fprintf(stderr, "%s: corrupt recording\n", path);
+
+	rec_reader_close(&rec);
+	return count < 0 ? -1 : 0;
+}
+
+static int read_device(struct session_tracker *st, const char *path)
+{
+	struct input_event events[64];
+	struct pen_assembler pa;
+	int fd, n;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		perror("open error");
+		return -1;
+	}
+
+	pen_assembler_init(&pa, fd);
+	pen_assembler_resync(&pa);
+
+	while (running && (n = read(fd, events, sizeof(events))) > 0)
+		feed(st, &pa, events, n / sizeof(events[0]));
+
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct session_tracker st;
+	const struct tool_session *s;
+	struct sigaction sa;
+	const char *recording = NULL;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, "r:vh")) != -1) {
+		switch (opt) {
+			case 'r': recording = optarg; break;
+			case 'v': verbose = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s [-v] /dev/input/eventX\n", argv[0]);
+				fprintf(stderr, "       %s [-v] -r capture.rec\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	if (!recording && optind != argc - 1) {
+		fprintf(stderr, "Usage: %s [-v] /dev/input/eventX\n", argv[0]);
+		exit(1);
+	}
+
+	/* no SA_RESTART, Ctrl-C has to interrupt the read() */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sighandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if (session_tracker_init(&st, MAX_SESSIONS, MAX_STROKES, MAX_FRAMES) < 0)
+		exit(1);
+
+	if (recording)
+		rc = read_recording(&st, recording);
+	else
+		rc = read_device(&st, argv[optind]);
+
+	s = session_tracker_close(&st);
+	if (s)
+		session_done(&st, s);
+	print_totals(&st);
+
+	session_tracker_free(&st);
+	return rc < 0;
+}
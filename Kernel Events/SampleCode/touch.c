@@ -0,0 +1,93 @@
+/* print the touch contacts of a multitouch (protocol B) node
+ *
+ * to compile:
+ *  gcc -o touch touch.c mt-slots.c
+ *
+ * to run:
+ *  find your touch device in /dev/input/...
+ *  sudo ./touch /dev/input/eventX
+ *
+ * hint: compile and run devices.c first to find the
+ * /dev/input/eventX that the touch sensor is associated with
+ *
+ * The slots are tracked by mt-slots.c. One line is printed per slot
+ * that changed in a frame, so a finger lifted off shows up as "up" and
+ * fingers that didn't move aren't repeated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+#include "mt-slots.h"
+
+static void print_frame(const struct input_event *ev, struct mt_state *mt)
+{
+	int s;
+
+	for (s = mt_next_changed(mt, -1); s >= 0; s = mt_next_changed(mt, s)) {
+		int32_t id = mt_value(mt, MT_TRACKING_ID, s);
+
+		if (id == -1) {
+			printf("%ld.%06ld slot %2d up\n",
+			       (long) ev->time.tv_sec, (long) ev->time.tv_usec, s);
+			continue;
+		}
+
+		printf("%ld.%06ld slot %2d id %5d x %5d y %5d major %4d minor %4d orientation %4d pressure %4d\n",
+		       (long) ev->time.tv_sec, (long) ev->time.tv_usec, s, id,
+		       mt_value(mt, MT_POSITION_X, s),
+		       mt_value(mt, MT_POSITION_Y, s),
+		       mt_value(mt, MT_TOUCH_MAJOR, s),
+		       mt_value(mt, MT_TOUCH_MINOR, s),
+		       mt_value(mt, MT_ORIENTATION, s),
+		       mt_value(mt, MT_PRESSURE, s));
+	}
+
+	mt_clear_changed(mt);
+}
+
+int main(int argc, char *argv[])
+{
+	struct input_event events[64];
+	struct mt_state mt;
+	unsigned long resyncs;
+	int fd, i, n;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s /dev/input/eventX\n", argv[0]);
+		exit(1);
+	}
+
+	if ((fd = open(argv[1], O_RDONLY)) < 0) {
+		perror("open error");
+		exit(1);
+	}
+
+	if (mt_init(&mt, fd) < 0)
+		exit(1);
+
+	printf("%d slots, %d contacts down\n", mt.nslots, mt.ncontacts);
+	mt_clear_changed(&mt);
+	resyncs = mt.nresyncs;
+
+	while ((n = read(fd, events, sizeof(events))) > 0) {
+		for (i = 0; i < n / (int) sizeof(events[0]); i++) {
+			if (!mt_feed(&mt, &events[i]))
+				continue;
+
+			if (mt.nresyncs != resyncs) {
+				printf("dropped events, resynced %d contacts\n",
+				       mt.ncontacts);
+				resyncs = mt.nresyncs;
+			}
+			print_frame(&events[i], &mt);
+		}
+	}
+
+	mt_free(&mt);
+	close(fd);
+	return 0;
+}
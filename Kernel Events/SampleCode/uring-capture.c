@@ -0,0 +1,305 @@
+/* io_uring capture backend
+ *
+ * See uring-capture.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include "uring-capture.h"
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		       unsigned flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, arg, argsz);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg, unsigned nargs)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+/* user_data of the poll half of a poll + read pair */
+#define POLL_TAG	(1ULL << 32)
+
+/* Queue a read of one batch into the device's buffer. The nodes are
+ * non-blocking, so io_uring would hand back EAGAIN instead of waiting;
+ * a poll linked in front of the read makes the read start only once
+ * the node is readable. Both are submitted with the next
+ * io_uring_enter().
+ */
+static void queue_read(struct uring_capture *uc, struct capture_device *dev)
+{
+	unsigned tail = *uc->sq_tail;
+	struct io_uring_sqe *sqe;
+
+	sqe = &uc->sqes[tail++ & uc->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK | uc->skip_poll_cqe;
+	sqe->fd = dev->index;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = POLL_TAG | dev->index;
+
+	sqe = &uc->sqes[tail++ & uc->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = dev->index;
+	sqe->off = (__u64) -1;	/* current position, evdev has none */
+	sqe->addr = (unsigned long) uc->buffers[dev->index];
+	sqe->len = sizeof(uc->buffers[0]);
+	sqe->buf_index = dev->index;
+	sqe->user_data = dev->index;
+
+	/* the kernel may look at the sqes as soon as it sees the new tail */
+	__atomic_store_n(uc->sq_tail, tail, __ATOMIC_RELEASE);
+}
+
+/* Drop the device from the registered files as well, otherwise the
+ * ring keeps the node open until it is closed */
+static void uring_remove_device(struct uring_capture *uc,
+				struct capture_device *dev, int error)
+{
+	struct io_uring_files_update update;
+	int fd = -1;
+
+	memset(&update, 0, sizeof(update));
+	update.offset = dev->index;
+	update.fds = (unsigned long) &fd;
+	uring_register(uc->fd, IORING_REGISTER_FILES_UPDATE, &update, 1);
+
+	dev->error = error;
+	capture_remove_device(uc->cap, dev);
+}
+
+static unsigned pending_submissions(const struct uring_capture *uc)
+{
+	return *uc->sq_tail - __atomic_load_n(uc->sq_head, __ATOMIC_ACQUIRE);
+}
+
+int uring_capture_init(struct uring_capture *uc, struct capture *cap)
+{
+	struct io_uring_params p;
+	struct iovec iov[CAPTURE_MAX_DEVICES];
+	int fds[CAPTURE_MAX_DEVICES];
+	unsigned *array;
+	unsigned i;
+	int n = cap->ndevices;
+
+	memset(uc, 0, sizeof(*uc));
+	uc->cap = cap;
+	uc->fd = -1;
+	uc->sq_ring = uc->cq_ring = uc->sqes = MAP_FAILED;
+
+	/* at most one poll + read pair per device is in flight, so the
+	 * queues can't overflow */
+	memset(&p, 0, sizeof(p));
+	uc->fd = uring_setup(2 * CAPTURE_MAX_DEVICES, &p);
+	if (uc->fd < 0) {
+		perror("io_uring_setup");
+		return -1;
+	}
+
+	/* 5.17 and later can leave out the completion of a poll that
+	 * worked, older kernels post it and it is ignored */
+	if (p.features & IORING_FEAT_CQE_SKIP)
+		uc->skip_poll_cqe = IOSQE_CQE_SKIP_SUCCESS;
+
+	uc->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	uc->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (uc->cq_ring_size > uc->sq_ring_size)
+			uc->sq_ring_size = uc->cq_ring_size;
+		uc->cq_ring_size = 0;
+	}
+
+	uc->sq_ring = mmap(NULL, uc->sq_ring_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, uc->fd, IORING_OFF_SQ_RING);
+	if (uc->sq_ring == MAP_FAILED)
+		goto err;
+
+	if (uc->cq_ring_size) {
+		uc->cq_ring = mmap(NULL, uc->cq_ring_size, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, uc->fd, IORING_OFF_CQ_RING);
+		if (uc->cq_ring == MAP_FAILED)
+			goto err;
+	}
+
+	uc->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	uc->sqes = mmap(NULL, uc->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, uc->fd, IORING_OFF_SQES);
+	if (uc->sqes == MAP_FAILED)
+		goto err;
+
+	uc->sq_head = (unsigned *) ((char *) uc->sq_ring + p.sq_off.head);
+	uc->sq_tail = (unsigned *) ((char *) uc->sq_ring + p.sq_off.tail);
+	uc->sq_mask = *(unsigned *) ((char *) uc->sq_ring + p.sq_off.ring_mask);
+	array = (unsigned *) ((char *) uc->sq_ring + p.sq_off.array);
+
+	/* sqe i always sits in array slot i */
+	for (i = 0; i < p.sq_entries; i++)
+		array[i] = i;
+
+	{
+		char *cq = uc->cq_ring_size ? uc->cq_ring : uc->sq_ring;
+
+		uc->cq_head = (unsigned *) (cq + p.cq_off.head);
+		uc->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+		uc->cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+		uc->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+	}
+
+	/* fixed buffers are pinned once here instead of on every read */
+	uc->buffers = mmap(NULL, CAPTURE_MAX_DEVICES * sizeof(uc->buffers[0]),
+			   PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (uc->buffers == MAP_FAILED) {
+		uc->buffers = NULL;
+		goto err;
+	}
+
+	if (n == 0) {
+		fprintf(stderr, "io_uring: no devices\n");
+		uring_capture_close(uc);
+		return -1;
+	}
+
+	for (i = 0; i < (unsigned) n; i++) {
+		iov[i].iov_base = uc->buffers[i];
+		iov[i].iov_len = sizeof(uc->buffers[0]);
+		fds[i] = cap->devices[i].fd;	/* -1 leaves the slot empty */
+	}
+
+	if (uring_register(uc->fd, IORING_REGISTER_BUFFERS, iov, n) < 0 ||
+	    uring_register(uc->fd, IORING_REGISTER_FILES, fds, n) < 0)
+		goto err;
+
+	for (i = 0; i < (unsigned) n; i++)
+		if (cap->devices[i].fd >= 0)
+			queue_read(uc, &cap->devices[i]);
+
+	return 0;
+
+err:
+	perror("io_uring");
+	uring_capture_close(uc);
+	return -1;
+}
+
+void uring_capture_close(struct uring_capture *uc)
+{
+	/* closing the ring cancels the reads still in flight */
+	if (uc->fd >= 0)
+		close(uc->fd);
+	if (uc->sqes != MAP_FAILED)
+		munmap(uc->sqes, uc->sqes_size);
+	if (uc->cq_ring != MAP_FAILED && uc->cq_ring_size)
+		munmap(uc->cq_ring, uc->cq_ring_size);
+	if (uc->sq_ring != MAP_FAILED)
+		munmap(uc->sq_ring, uc->sq_ring_size);
+	if (uc->buffers)
+		munmap(uc->buffers, CAPTURE_MAX_DEVICES * sizeof(uc->buffers[0]));
+
+	uc->fd = -1;
+	uc->sq_ring = uc->cq_ring = uc->sqes = MAP_FAILED;
+	uc->buffers = NULL;
+}
+
+int uring_capture_dispatch(struct uring_capture *uc, int timeout,
+			   capture_func func, void *data)
+{
+	struct capture *cap = uc->cap;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned head, tail, flags;
+	int total = 0;
+
+	head = *uc->cq_head;
+	tail = __atomic_load_n(uc->cq_tail, __ATOMIC_ACQUIRE);
+
+	/* one call submits the reads queued last time and waits for the
+	 * next completion; skipped if completions are already waiting */
+	if (head == tail || pending_submissions(uc)) {
+		memset(&arg, 0, sizeof(arg));
+		flags = 0;
+		if (head == tail) {
+			flags |= IORING_ENTER_GETEVENTS;
+			if (timeout >= 0) {
+				ts.tv_sec = timeout / 1000;
+				ts.tv_nsec = (timeout % 1000) * 1000000LL;
+				arg.ts = (unsigned long) &ts;
+				flags |= IORING_ENTER_EXT_ARG;
+			}
+		}
+
+		cap->stats.syscalls++;
+		if (uring_enter(uc->fd, pending_submissions(uc), head == tail,
+				flags, flags & IORING_ENTER_EXT_ARG ? &arg : NULL,
+				sizeof(arg)) < 0 &&
+		    errno != ETIME && errno != EINTR && errno != EBUSY)
+			return -1;
+
+		tail = __atomic_load_n(uc->cq_tail, __ATOMIC_ACQUIRE);
+		if (head == tail)
+			return 0;
+	}
+
+	cap->stats.wakeups++;
+
+	for (; head != tail; head++) {
+		const struct io_uring_cqe *cqe = &uc->cqes[head & uc->cq_mask];
+		struct capture_device *dev = &cap->devices[cqe->user_data & 0xffff];
+		int res = cqe->res;
+
+		if (dev->fd < 0)
+			continue;
+
+		/* a failed poll cancels its read, which completes with
+		 * -ECANCELED and is handled below with the poll's error */
+		if (cqe->user_data & POLL_TAG) {
+			if (res < 0)
+				uc->poll_error[dev->index] = -res;
+			continue;
+		}
+
+		if (res == -EAGAIN || res == -EINTR) {
+			queue_read(uc, dev);
+			continue;
+		}
+
+		if (res <= 0) {
+			/* -ENODEV: unplugged, 0: end of a replay pipe */
+			if (res == -ECANCELED && uc->poll_error[dev->index])
+				res = -uc->poll_error[dev->index];
+			uring_remove_device(uc, dev, -res);
+			continue;
+		}
+
+		func(dev, uc->buffers[dev->index], res / sizeof(struct input_event), data);
+		total += res / sizeof(struct input_event);
+
+		/* the buffer is handed back to the kernel only now */
+		queue_read(uc, dev);
+	}
+
+	__atomic_store_n(uc->cq_head, head, __ATOMIC_RELEASE);
+
+	cap->stats.events += total;
+	return total;
+}
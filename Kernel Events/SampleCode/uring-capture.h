@@ -0,0 +1,69 @@
+/* io_uring capture backend
+ *
+ * Alternative to capture_dispatch() for hosts with many tablets. The
+ * devices of a struct capture are registered with an io_uring as fixed
+ * files, together with one fixed CAPTURE_BATCH buffer per device, and
+ * every device always has one read in flight. A read completes as soon
+ * as the device has events; the consumer gets the batch and the read
+ * is queued again, to go out with the next wait. So however many
+ * devices had events, a wakeup costs one io_uring_enter() instead of an
+ * epoll_wait() plus one read() per device.
+ *
+ * The nodes are opened non-blocking by capture.c, so each read is
+ * queued behind a linked poll and io_uring waits for the node instead
+ * of blocking a worker thread on it.
+ *
+ * Uses the raw system calls (no liburing) and needs Linux 5.11 for the
+ * wait timeout. Devices must be added to the capture before
+ * uring_capture_init().
+ */
+
+#ifndef URING_CAPTURE_H
+#define URING_CAPTURE_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+#include "capture.h"
+
+struct uring_capture {
+	struct capture *cap;
+	int fd;
+
+	/* submission queue */
+	void *sq_ring;
+	size_t sq_ring_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	/* completion queue, may share the mapping of the sq ring */
+	void *cq_ring;
+	size_t cq_ring_size;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	unsigned char skip_poll_cqe;	/* IOSQE_CQE_SKIP_SUCCESS if supported */
+
+	/* errno of a failed poll, reported instead of its read's -ECANCELED */
+	int poll_error[CAPTURE_MAX_DEVICES];
+
+	/* one registered buffer per device, buffers[dev->index] */
+	struct input_event (*buffers)[CAPTURE_BATCH];
+};
+
+/* Set up the ring and start reading every open device of cap.
+ * Returns -1 if io_uring is not available.
+ */
+int uring_capture_init(struct uring_capture *uc, struct capture *cap);
+void uring_capture_close(struct uring_capture *uc);
+
+/* Same contract as capture_dispatch() */
+int uring_capture_dispatch(struct uring_capture *uc, int timeout,
+			   capture_func func, void *data);
+
+#endif /* URING_CAPTURE_H */
@@ -6,6 +6,14 @@ To compile:
 To run the sample
 	./multitouch
 
+Drawing goes to a backbuffer and every paint function reports the area
+it touched. Those areas are collected in a region while the events
+queued in Xlib are handled, and only the region is composited onto the
+window once they are all done. Every 5 seconds the sample prints how
+many pixels per second it composited. To compare with repainting the
+whole window for every event, run
+	./multitouch --full-repaint
+
 Author: Peter Hutterer <peter.hutterer@who-t.net> 2012
 Under MIT License (https://choosealicense.com/licenses/mit)
 */
@@ -23,6 +31,7 @@ Under MIT License (https://choosealicense.com/licenses/mit)
 #include <poll.h>
 #include <stdint.h>
 #include <math.h>
+#include <time.h>
 
 #include <errno.h>
 
@@ -36,15 +45,18 @@ Under MIT License (https://choosealicense.com/licenses/mit)
 #define MAX_TOUCHES 10
 #define NWINDOWS 8 /* windows on sidebar */
 #define POINTER_TOUCHID 0xFFFFFFFF
+#define DAMAGE_MARGIN 2 /* line width and antialiasing around a shape */
+#define STATS_INTERVAL 5 /* seconds */
 
 static void usage(void)
 {
-    printf("Usage: %s [--with-ownership|--pointer-events|--core-events]\n", program_invocation_short_name);
+    printf("Usage: %s [--with-ownership|--pointer-events|--core-events] [--full-repaint]\n", program_invocation_short_name);
     printf("	Grey window: normal touch surface, with or without ownership (or XI2 pointer/core events)\n");
     printf("	Upper black bar left: grabs the touchpoint, no ownership, accepts\n");
     printf("	Upper White bar left: grabs the touchpoint, no ownership, rejects\n");
     printf("	Lower black bar left: grabs the touchpoint, with ownership, accepts\n");
     printf("	Lower White bar left: grabs the touchpoint, with ownership, rejects\n");
+    printf("	--full-repaint: composite the whole window for every event, not just the damage\n");
 }
 
 enum Mode {
@@ -111,6 +123,14 @@ struct multitouch {
     cairo_surface_t *surface_win;
     cairo_surface_t *surface_grabs;
 
+    cairo_region_t *damage; /* drawn to the backbuffers, not on screen yet */
+    Bool full_repaint;
+
+    /* composited since the last report */
+    unsigned long long pixels;
+    unsigned long composites;
+    double stats_start;
+
     struct touchpoint touches[MAX_TOUCHES];
     int ntouches;
 
@@ -325,6 +345,8 @@ static int init_x11(struct multitouch *mt, int width, int height, enum Mode mode
 
 static void teardown(struct multitouch *mt)
 {
+    if (mt->damage)
+        cairo_region_destroy(mt->damage);
     if (mt->win)
         XUnmapWindow(mt->dpy, mt->win);
     XCloseDisplay(mt->dpy);
@@ -783,8 +805,8 @@ static void paint_core_event(struct multitouch *mt, XButtonEvent *event)
             cairo_line_to(mt->cr, event->x - xsize/2, event->y);
         }
         cairo_stroke(mt->cr);
-        expose(mt, event->x - xsize/2, event->x - xsize/2,
-                   event->x + xsize/2, event->x + xsize/2);
+        expose(mt, event->x - xsize/2, event->y - xsize/2,
+                   event->x + xsize/2, event->y + xsize/2);
     }
 
     cairo_restore(mt->cr);
@@ -807,7 +829,7 @@ static void handle_ownership(struct multitouch *mt, XITouchOwnershipEvent *event
     cairo_arc(mt->cr, t->x, t->y, radius, 0, 2 * M_PI);
     cairo_stroke(mt->cr);
     cairo_restore(mt->cr);
-    expose(mt, t->x - radius/2, t->y - radius/2, t->x + radius/2, t->y + radius/2);
+    expose(mt, t->x - radius, t->y - radius, t->x + radius, t->y + radius);
 }
 
 static void paint_pointer_event(struct multitouch *mt, XIDeviceEvent *event)
@@ -848,8 +870,8 @@ static void paint_pointer_event(struct multitouch *mt, XIDeviceEvent *event)
             cairo_line_to(mt->cr, event->event_x - xsize/2, event->event_y);
         }
         cairo_stroke(mt->cr);
-        expose(mt, event->event_x - xsize/2, event->event_x - xsize/2,
-                   event->event_x + xsize/2, event->event_x + xsize/2);
+        expose(mt, event->event_x - xsize/2, event->event_y - xsize/2,
+                   event->event_x + xsize/2, event->event_y + xsize/2);
     }
 
     cairo_restore(mt->cr);
@@ -944,12 +966,23 @@ static int init_cairo(struct multitouch *mt)
 
     mt->cr = cr;
 
+    mt->damage = cairo_region_create();
     expose(mt, 0, 0, mt->width, mt->height);
 
     return EXIT_SUCCESS;
 }
 
-static void expose(struct multitouch *mt, int x1, int y1, int x2, int y2)
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Put the backbuffer and the grabs on top of it onto the window,
+ * clipped to the current path if there is one */
+static void composite(struct multitouch *mt)
 {
     cairo_set_source_surface(mt->cr_win, mt->surface, 0, 0);
     cairo_paint(mt->cr_win);
@@ -959,17 +992,91 @@ static void expose(struct multitouch *mt, int x1, int y1, int x2, int y2)
     cairo_mask_surface(mt->cr_win, mt->surface_grabs, 0, 0);
     cairo_restore(mt->cr_win);
 
+    mt->composites++;
+}
+
+/* The area between x1/y1 and x2/y2, in any order, has changed. It is
+ * added to the damage and put on screen with the next flush_damage(). */
+static void expose(struct multitouch *mt, int x1, int y1, int x2, int y2)
+{
+    cairo_rectangle_int_t rect;
+
+    if (mt->full_repaint)
+    {
+        composite(mt);
+        mt->pixels += (unsigned long long)mt->width * mt->height;
+        return;
+    }
+
+    rect.x = (x1 < x2 ? x1 : x2) - DAMAGE_MARGIN;
+    rect.y = (y1 < y2 ? y1 : y2) - DAMAGE_MARGIN;
+    rect.width = abs(x2 - x1) + 2 * DAMAGE_MARGIN + 1;
+    rect.height = abs(y2 - y1) + 2 * DAMAGE_MARGIN + 1;
+    cairo_region_union_rectangle(mt->damage, &rect);
+}
+
+/* Composite what was damaged since the last flush, once */
+static void flush_damage(struct multitouch *mt)
+{
+    cairo_rectangle_int_t rect = { 0, 0, mt->width, mt->height };
+    int i, n;
+
+    cairo_region_intersect_rectangle(mt->damage, &rect);
+    n = cairo_region_num_rectangles(mt->damage);
+    if (n == 0)
+        return;
+
+    cairo_save(mt->cr_win);
+    for (i = 0; i < n; i++)
+    {
+        cairo_region_get_rectangle(mt->damage, i, &rect);
+        cairo_rectangle(mt->cr_win, rect.x, rect.y, rect.width, rect.height);
+        mt->pixels += (unsigned long long)rect.width * rect.height;
+    }
+    cairo_clip(mt->cr_win);
+    composite(mt);
+    cairo_restore(mt->cr_win);
+
+    cairo_region_destroy(mt->damage);
+    mt->damage = cairo_region_create();
+}
+
+static void print_stats(struct multitouch *mt)
+{
+    double elapsed = now() - mt->stats_start;
+
+    if (mt->composites)
+        msg("composited %.0f pixels/s in %.1f composites/s (%s)\n",
+            mt->pixels / elapsed, mt->composites / elapsed,
+            mt->full_repaint ? "full window per event" : "damage per batch");
+
+    mt->pixels = 0;
+    mt->composites = 0;
+    mt->stats_start = now();
 }
 
 static int main_loop(struct multitouch *mt)
 {
     struct pollfd fd;
 
+    double next;
+
     fd.fd = ConnectionNumber(mt->dpy);
     fd.events = POLLIN;
+    mt->stats_start = now();
+    next = mt->stats_start + STATS_INTERVAL;
+
+    /* what init_cairo() drew */
+    flush_damage(mt);
+    XFlush(mt->dpy);
 
     while (running)
     {
+        if (now() >= next)
+        {
+            print_stats(mt);
+            next = now() + STATS_INTERVAL;
+        }
 
         if (poll(&fd, 1, 500) <= 0)
             continue;
@@ -998,8 +1105,14 @@ static int main_loop(struct multitouch *mt)
 
             XFreeEventData(mt->dpy, cookie);
         }
+
+        /* the queue is empty, everything the batch drew goes out in
+         * one go */
+        flush_damage(mt);
+        XFlush(mt->dpy);
     }
 
+    print_stats(mt);
     return EXIT_SUCCESS;
 }
 
@@ -1015,31 +1128,37 @@ static void init(struct multitouch *mt, Bool ownership)
 
 int main(int argc, char **argv)
 {
-    int rc;
+    int rc, i;
     struct multitouch mt;
     Bool ownership = False;
+    Bool full_repaint = False;
     enum Mode mode = MODE_DEFAULT;
 
     usage();
 
-    if (argc > 1)
+    for (i = 1; i < argc; i++)
     {
-        if(strcmp(argv[1], "--with-ownership") == 0)
+        if(strcmp(argv[i], "--with-ownership") == 0)
         {
             mode = MODE_OWNERSHIP;
             msg("ownership events selected\n");
-        } else if (strcmp(argv[1], "--pointer-events") == 0)
+        } else if (strcmp(argv[i], "--pointer-events") == 0)
         {
             mode = MODE_POINTER;
             msg("pointer events selected\n");
-        } else if (strcmp(argv[1], "--core-events") == 0)
+        } else if (strcmp(argv[i], "--core-events") == 0)
         {
             mode = MODE_CORE;
             msg("core events selected\n");
+        } else if (strcmp(argv[i], "--full-repaint") == 0)
+        {
+            full_repaint = True;
+            msg("full window repaint for every event\n");
         }
     }
 
     init(&mt, ownership);
+    mt.full_repaint = full_repaint;
 
     rc = init_x11(&mt, 800, 600, mode);
     if (rc != EXIT_SUCCESS)
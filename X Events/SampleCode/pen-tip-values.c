@@ -4,127 +4,718 @@ To compile:
 	gcc -o pen-tip-values pen-tip-values.c -lX11 -lXi
 
 To run the sample
-	./find-pressure
-
+	./pen-tip-values
+
+Print only the statistics, every 10 seconds instead of 5, to see how
+much time the client itself needs per event:
+	./pen-tip-values -q -s 10
+
+Every pen, eraser and touch device of every connected tablet is
+selected. What a device is comes from the Wacom Tool Type property of
+the wacom driver, or from its classes with other drivers. It is worked
+out once, when the device shows up: at startup, or when an
+XI_HierarchyChanged event says it was added or enabled. Tablets can be
+plugged in and out while the sample runs.
+
+The valuator labels of a device are looked up once, with a single
+XGetAtomNames request, and the well known axes mapped to fixed slots.
+Raw events are decoded through that table and only an XI_DeviceChanged
+event for the device makes the sample look at the labels again.
+
+Events are not read one XNextEvent at a time. The sample sleeps in
+poll() on the connection, then takes everything Xlib has queued,
+decodes it into a preallocated batch and hands the batch to the output
+in one go. The time spent per event, in Xlib and decoding and in the
+output, is printed periodically and on exit.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/XInput2.h>
 
-static void print_valuators(Display *display, XIAnyClassInfo **classes, int num_classes)
+/* Axes every Wacom tool has, in fixed slots. The labels are the ones
+ * the wacom and libinput drivers give their valuators. */
+enum axis {
+    AXIS_X,
+    AXIS_Y,
+    AXIS_PRESSURE,
+    AXIS_TILT_X,
+    AXIS_TILT_Y,
+    AXIS_WHEEL,
+    NAXES
+};
+
+static const char *axis_labels[NAXES] = {
+    [AXIS_X] = "Abs X",
+    [AXIS_Y] = "Abs Y",
+    [AXIS_PRESSURE] = "Abs Pressure",
+    [AXIS_TILT_X] = "Abs Tilt X",
+    [AXIS_TILT_Y] = "Abs Tilt Y",
+    [AXIS_WHEEL] = "Abs Wheel",
+};
+
+/* libinput puts the position of a touch on the MT axes */
+static const char *mt_labels[2] = {
+    [AXIS_X] = "Abs MT Position X",
+    [AXIS_Y] = "Abs MT Position Y",
+};
+
+#define MAX_VALUATORS 36
+#define MAX_DEVICES 16
+#define MASK_CACHE_LEN 8    /* bytes of a raw event mask the cache covers */
+#define BATCH_SIZE 256
+
+struct valuator {
+    char *label;        /* from XGetAtomNames, NULL if unlabeled */
+    double min, max;
+    int resolution;
+    int mode;
+};
+
+/* What the valuators of a device are, resolved once. Raw events only
+ * carry valuator numbers; slot[] turns them into axes without a round
+ * trip to the server or a string compare. Rebuilt on XI_DeviceChanged.
+ */
+struct valuator_schema {
+    int deviceid;
+    int nvaluators;             /* highest valuator number + 1 */
+    struct valuator valuators[MAX_VALUATORS];
+    int slot[MAX_VALUATORS];    /* valuator number -> enum axis, -1 if none */
+    int number[NAXES];          /* enum axis -> valuator number, -1 if missing */
+
+    /* The mask of the last raw event, and for each value it carried
+     * the slot it goes to. A tool sends the same axes in almost every
+     * event, so the mask is compared instead of walked bit by bit. */
+    int mask_len;               /* -1: nothing cached */
+    unsigned char mask[MASK_CACHE_LEN];
+    int nvalues;
+    int value_slot[MAX_VALUATORS];
+    unsigned int mask_present;
+};
+
+enum device_type {
+    DEVICE_PEN,
+    DEVICE_ERASER,
+    DEVICE_TOUCH,
+};
+
+static const char *device_types[] = {
+    [DEVICE_PEN] = "pen",
+    [DEVICE_ERASER] = "eraser",
+    [DEVICE_TOUCH] = "touch",
+};
+
+struct tracked_device {
+    enum device_type type;
+    unsigned int tablet_id;     /* from Wacom Serial IDs, 0 without it */
+    struct valuator_schema schema;  /* schema.deviceid 0: entry unused */
+};
+
+/* Every pen, eraser and touch device of every tablet. Devices are
+ * classified when they show up, at startup or with XI_HierarchyChanged,
+ * never again after that. */
+struct device_tracker {
+    Window root;
+    int touch_events;           /* server does XI 2.2 raw touch events */
+    Atom prop_tool_type, prop_serial_ids;
+    Atom type_stylus, type_eraser, type_touch;
+    Atom label_pressure;
+    int ndevices;
+    struct tracked_device devices[MAX_DEVICES];
+};
+
+/* One decoded raw event */
+struct pen_sample {
+    Time time;
+    int deviceid;
+    int touchid;                /* -1 for pen and eraser */
+    unsigned int present;       /* 1 << enum axis for each axis in the event */
+    double axes[NAXES];
+};
+
+struct drain_stats {
+    unsigned long events;
+    unsigned long batches;
+    int max_batch;
+    double decode;              /* seconds in Xlib and decoding */
+    double output;              /* seconds in the sink */
+    double start;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void sighandler(int signal)
+{
+    running = 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void free_schema(struct valuator_schema *schema)
 {
     int i;
 
+    for (i = 0; i < schema->nvaluators; i++)
+        if (schema->valuators[i].label)
+            XFree(schema->valuators[i].label);
+    schema->nvaluators = 0;
+}
+
+static void build_schema(Display *display, struct valuator_schema *schema,
+                         int deviceid, XIAnyClassInfo **classes, int num_classes)
+{
+    Atom atoms[MAX_VALUATORS];
+    char *names[MAX_VALUATORS] = { NULL };
+    int index[MAX_VALUATORS];
+    int i, a, natoms = 0;
+
+    free_schema(schema);
+    schema->deviceid = deviceid;
+    schema->mask_len = -1;
+    memset(schema->valuators, 0, sizeof(schema->valuators));
+    for (i = 0; i < MAX_VALUATORS; i++)
+        schema->slot[i] = -1;
+    for (a = 0; a < NAXES; a++)
+        schema->number[a] = -1;
+
     for (i = 0; i < num_classes; i++) {
-        if (classes[i]->type == XIValuatorClass) {
-                    XIValuatorClassInfo *v = (XIValuatorClassInfo*)classes[i];
-                    printf("Valuator %d: '%s'\n", v->number, (v->label) ?  XGetAtomName(display, v->label) : "No label");
-                    printf("\tRange: %f - %f\n", v->min, v->max);
-                    printf("\tResolution: %d units/m\n", v->resolution);
-                    printf("\tMode: %s\n", v->mode == XIModeAbsolute ? "absolute": "relative");
-                    if (v->mode == XIModeAbsolute)
-                        printf("\tCurrent value: %f\n", v->value);
+        XIValuatorClassInfo *v = (XIValuatorClassInfo*)classes[i];
+
+        if (v->type != XIValuatorClass || v->number >= MAX_VALUATORS)
+            continue;
+
+        schema->valuators[v->number].min = v->min;
+        schema->valuators[v->number].max = v->max;
+        schema->valuators[v->number].resolution = v->resolution;
+        schema->valuators[v->number].mode = v->mode;
+        if (v->number >= schema->nvaluators)
+            schema->nvaluators = v->number + 1;
+
+        if (v->label) {
+            atoms[natoms] = v->label;
+            index[natoms] = v->number;
+            natoms++;
+        }
+    }
+
+    if (natoms == 0)
+        return;
+
+    /* all labels in one request instead of a round trip per valuator;
+     * if some atoms are bad it returns 0 but still fills in the others,
+     * which are kept, the bad ones are left NULL */
+    XGetAtomNames(display, atoms, natoms, names);
+
+    for (i = 0; i < natoms; i++) {
+        schema->valuators[index[i]].label = names[i];
+        for (a = 0; a < NAXES; a++) {
+            if (names[i] && (strcmp(names[i], axis_labels[a]) == 0 ||
+                             (a < 2 && strcmp(names[i], mt_labels[a]) == 0))) {
+                schema->slot[index[i]] = a;
+                schema->number[a] = index[i];
+            }
         }
     }
 }
 
-static void device_info(Display *display, int deviceid)
+static void print_schema(const struct valuator_schema *schema)
 {
-	XIDeviceInfo *info, *dev;
-	int i, ndevices;
+    int i;
 
-	dev = XIQueryDevice(display, deviceid, &ndevices);
+    for (i = 0; i < schema->nvaluators; i++) {
+        const struct valuator *v = &schema->valuators[i];
 
-	printf("Device Name: '%s' (%d)\n", dev->name, dev->deviceid);
-	print_valuators(display, dev->classes, dev->num_classes);
+        printf("Valuator %d: '%s'\n", i, v->label ? v->label : "No label");
+        printf("\tRange: %f - %f\n", v->min, v->max);
+        printf("\tResolution: %d units/m\n", v->resolution);
+        printf("\tMode: %s\n", v->mode == XIModeAbsolute ? "absolute": "relative");
+    }
 }
 
-static int find_stylus(Display *display, int deviceid)
+static void device_info(Display *display, XIDeviceInfo *dev,
+                        struct valuator_schema *schema)
 {
-        XIDeviceInfo *info, *dev;
-        int ndevices;
-        int i;
-        char * word;
-        int stylus = 0;
+    printf("Device Name: '%s' (%d)\n", dev->name, dev->deviceid);
+    build_schema(display, schema, dev->deviceid, dev->classes, dev->num_classes);
+    print_schema(schema);
+}
+
+/* The first 32 bit item of a device property, -1 if the device has no
+ * such property. XI2 properties are packed, unlike XGetWindowProperty()
+ * a format 32 item is 4 bytes. */
+static int get_property(Display *dpy, int deviceid, Atom property,
+                        unsigned int *value)
+{
+    Atom type;
+    int format, rc = -1;
+    unsigned long nitems, bytes_after;
+    unsigned char *data = NULL;
+
+    if (XIGetProperty(dpy, deviceid, property, 0, 1, False, AnyPropertyType,
+                      &type, &format, &nitems, &bytes_after, &data) != Success)
+        return -1;
+
+    if (type != None && format == 32 && nitems > 0) {
+        *value = *(uint32_t *)data;
+        rc = 0;
+    }
+    if (data)
+        XFree(data);
+    return rc;
+}
 
-        info = XIQueryDevice(display, deviceid, &ndevices);
+/* What a device is: the wacom driver says so in its Wacom Tool Type
+ * property. Other drivers don't have it, for those a Wacom device with
+ * a touch class is touch and one with a pressure valuator a pen.
+ * Returns -1 for anything else (pads, cursors, other vendors). */
+static int classify(Display *dpy, struct device_tracker *tracker,
+                    XIDeviceInfo *dev, unsigned int *tablet_id)
+{
+    unsigned int tool_type;
+    int i, type = -1;
 
-        for(i = 0; i < ndevices; i++) {
-                dev = &info[i];
+    if (dev->use != XISlavePointer && dev->use != XIFloatingSlave)
+        return -1;
 
-                word = strtok (dev->name," ");
-                while (1) {
-                        word = strtok (NULL, " ");
-                        if (!word)
-				break;
-				if (strcmp("stylus", word) == 0)
-				stylus = dev->deviceid;
-                }
+    *tablet_id = 0;
+    if (get_property(dpy, dev->deviceid, tracker->prop_tool_type, &tool_type) == 0) {
+        /* the first of the serial ids is the tablet's product id */
+        get_property(dpy, dev->deviceid, tracker->prop_serial_ids, tablet_id);
+        if (tool_type == tracker->type_stylus)
+            type = DEVICE_PEN;
+        else if (tool_type == tracker->type_eraser)
+            type = DEVICE_ERASER;
+        else if (tool_type == tracker->type_touch)
+            type = DEVICE_TOUCH;
+    } else if (strncmp("Wacom", dev->name, 5) == 0) {
+        for (i = 0; i < dev->num_classes; i++) {
+            XIValuatorClassInfo *v = (XIValuatorClassInfo*)dev->classes[i];
+
+            if (v->type == XITouchClass) {
+                type = DEVICE_TOUCH;
+                break;
+            }
+            if (v->type == XIValuatorClass && v->label == tracker->label_pressure)
+                type = DEVICE_PEN;
         }
+    }
+
+    /* raw touch events came with 2.2 */
+    if (type == DEVICE_TOUCH && !tracker->touch_events)
+        type = -1;
+    return type;
+}
+
+static struct tracked_device *find_device(struct device_tracker *tracker,
+                                          int deviceid)
+{
+    int i;
+
+    for (i = 0; i < MAX_DEVICES; i++)
+        if (tracker->devices[i].schema.deviceid == deviceid)
+            return &tracker->devices[i];
+    return NULL;
+}
 
-        if (stylus) {
-                printf("Selected Device with ID %i\n", stylus);
-		device_info(display, stylus);
-	} else {
-                printf("no tablet connected\n");
-	}
+/* Select the raw events of one device, the masks of the others stay */
+static void select_device(Display *dpy, struct device_tracker *tracker,
+                          const struct tracked_device *dev)
+{
+    unsigned char bits[XIMaskLen(XI_LASTEVENT)] = { 0 };
+    XIEventMask mask;
+
+    mask.deviceid = dev->schema.deviceid;
+    mask.mask_len = sizeof(bits);
+    mask.mask = bits;
+    if (dev->type == DEVICE_TOUCH) {
+        XISetMask(bits, XI_RawTouchBegin);
+        XISetMask(bits, XI_RawTouchUpdate);
+        XISetMask(bits, XI_RawTouchEnd);
+    } else {
+        XISetMask(bits, XI_RawMotion);
+    }
+    /* the tool or its axes changed, the schema has to be rebuilt */
+    XISetMask(bits, XI_DeviceChanged);
 
-	return stylus;
+    XISelectEvents(dpy, tracker->root, &mask, 1);
 }
 
+static void add_device(Display *dpy, struct device_tracker *tracker,
+                       XIDeviceInfo *info)
+{
+    struct tracked_device *dev;
+    unsigned int tablet_id;
+    int type;
+
+    if (find_device(tracker, info->deviceid))
+        return;
+
+    type = classify(dpy, tracker, info, &tablet_id);
+    if (type < 0)
+        return;
+
+    dev = find_device(tracker, 0);
+    if (!dev) {
+        printf("Too many devices, not tracking %d\n", info->deviceid);
+        return;
+    }
+
+    dev->type = type;
+    dev->tablet_id = tablet_id;
+    printf("Tracking %s, tablet 0x%x\n", device_types[type], tablet_id);
+    /* the classes came with the list, no need to query again */
+    device_info(dpy, info, &dev->schema);
+    select_device(dpy, tracker, dev);
+    tracker->ndevices++;
+}
 
-static Window create_win(Display *dpy)
+static void remove_device(struct device_tracker *tracker, int deviceid)
 {
-	XIEventMask mask;
-	int stylus;
+    struct tracked_device *dev = find_device(tracker, deviceid);
 
-	Window win = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1200,
-		800, 0, 0, WhitePixel(dpy, 0));
+    /* a removed device takes its event selection with it */
+    if (!dev)
+        return;
+
+    printf("Device %d gone\n", deviceid);
+    free_schema(&dev->schema);
+    dev->schema.deviceid = 0;
+    tracker->ndevices--;
+}
+
+/* Add what the server has for deviceid, one device or XIAllDevices */
+static void query_devices(Display *dpy, struct device_tracker *tracker,
+                          int deviceid)
+{
+    XIDeviceInfo *info;
+    int ndevices, i;
+
+    info = XIQueryDevice(dpy, deviceid, &ndevices);
+    if (!info)
+        return;
+
+    for (i = 0; i < ndevices; i++)
+        add_device(dpy, tracker, &info[i]);
+
+    XIFreeDeviceInfo(info);
+}
+
+static void tracker_init(Display *dpy, struct device_tracker *tracker,
+                         Window root, int xi_minor)
+{
+    static char *names[] = {
+        "Wacom Tool Type", "Wacom Serial IDs",
+        "STYLUS", "ERASER", "TOUCH", "Abs Pressure",
+    };
+    Atom atoms[6];
+    unsigned char bits[XIMaskLen(XI_LASTEVENT)] = { 0 };
+    XIEventMask mask = { XIAllDevices, sizeof(bits), bits };
+
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->root = root;
+    tracker->touch_events = xi_minor >= 2;
+
+    /* created if they don't exist yet, the wacom driver may be loaded
+     * only when the first tablet is plugged in */
+    XInternAtoms(dpy, names, 6, False, atoms);
+    tracker->prop_tool_type = atoms[0];
+    tracker->prop_serial_ids = atoms[1];
+    tracker->type_stylus = atoms[2];
+    tracker->type_eraser = atoms[3];
+    tracker->type_touch = atoms[4];
+    tracker->label_pressure = atoms[5];
+
+    /* hotplug first, so a device added during the query isn't missed */
+    XISetMask(bits, XI_HierarchyChanged);
+    XISelectEvents(dpy, root, &mask, 1);
+
+    query_devices(dpy, tracker, XIAllDevices);
+    if (tracker->ndevices == 0)
+        printf("no tablet connected, waiting for one\n");
+}
+
+static void tracker_free(struct device_tracker *tracker)
+{
+    int i;
+
+    for (i = 0; i < MAX_DEVICES; i++)
+        free_schema(&tracker->devices[i].schema);
+}
+
+/* Devices were added, removed, enabled or disabled. Only the ones that
+ * changed are looked at, a device that comes back gets queried and
+ * classified again. */
+static void hierarchy_changed(Display *dpy, struct device_tracker *tracker,
+                              XIHierarchyEvent *event)
+{
+    int i;
+
+    for (i = 0; i < event->num_info; i++) {
+        XIHierarchyInfo *info = &event->info[i];
+
+        if (info->flags & (XISlaveRemoved | XIDeviceDisabled))
+            remove_device(tracker, info->deviceid);
+        else if (info->flags & XIDeviceEnabled)
+            query_devices(dpy, tracker, info->deviceid);
+    }
+}
 
-	stylus	= find_stylus(dpy, XIAllDevices);
-	if (stylus)
-    		mask.deviceid = stylus;
-	else
-		exit(0);
 
-	mask.mask_len = XIMaskLen(XI_RawMotion);
-    	mask.mask = calloc(mask.mask_len, sizeof(char));
-    	memset(mask.mask, 0, mask.mask_len);
-	XISetMask(mask.mask, XI_RawMotion);
+static Window create_win(Display *dpy, struct device_tracker *tracker,
+                         int xi_minor)
+{
+	Window win = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1200,
+		800, 0, 0, WhitePixel(dpy, 0));
 
-	XISelectEvents(dpy, DefaultRootWindow(dpy), &mask, 1);
+	tracker_init(dpy, tracker, DefaultRootWindow(dpy), xi_minor);
 
-	free(mask.mask);
 	XMapWindow(dpy, win);
-	XSync(dpy, True);
+	/* keep the events, a hierarchy change may already be queued */
+	XSync(dpy, False);
 	return win;
 }
 
 
-static void print_rawmotion(XIRawEvent *event)
+/* Work out which slot each value of a raw event with this mask goes to */
+static void cache_mask(struct valuator_schema *schema, const XIRawEvent *event)
 {
-    int i;
-    double *valuator = event->valuators.values;
+    int i, n = 0;
+
+    schema->mask_len = event->valuators.mask_len;
+    memcpy(schema->mask, event->valuators.mask, schema->mask_len);
+    schema->mask_present = 0;
+
+    for (i = 0; i < schema->mask_len * 8 && n < MAX_VALUATORS; i++) {
+        if (!XIMaskIsSet(event->valuators.mask, i))
+            continue;
+        schema->value_slot[n] = i < schema->nvaluators ? schema->slot[i] : -1;
+        if (schema->value_slot[n] >= 0)
+            schema->mask_present |= 1 << schema->value_slot[n];
+        n++;
+    }
+    schema->nvalues = n;
+}
+
+/* Decode the valuators of a raw motion or raw touch event into the
+ * fixed axis slots. Returns a bitmask of the axes present in the event. */
+static unsigned int decode_raw(struct valuator_schema *schema,
+                                     const XIRawEvent *event, double axes[NAXES])
+{
+    const double *valuator = event->valuators.values;
+    unsigned int present = 0;
+    int i, max;
+
+    if (event->valuators.mask_len <= MASK_CACHE_LEN) {
+        if (event->valuators.mask_len != schema->mask_len ||
+            memcmp(event->valuators.mask, schema->mask, schema->mask_len) != 0)
+            cache_mask(schema, event);
+
+        for (i = 0; i < schema->nvalues; i++)
+            if (schema->value_slot[i] >= 0)
+                axes[schema->value_slot[i]] = valuator[i];
+        return schema->mask_present;
+    }
+
+    /* a mask too long to cache, walk it */
+    max = event->valuators.mask_len * 8;
+    if (max > schema->nvaluators)
+        max = schema->nvaluators;
+
+    for (i = 0; i < max; i++) {
+        if (!XIMaskIsSet(event->valuators.mask, i))
+            continue;
+        if (schema->slot[i] >= 0) {
+            axes[schema->slot[i]] = *valuator;
+            present |= 1 << schema->slot[i];
+        }
+        valuator++;
+    }
+
+    return present;
+}
+
+/* The sink: format a whole batch into one buffer, one write */
+static void print_batch(const struct pen_sample *batch, int n, int quiet)
+{
+    static char buf[BATCH_SIZE * 256];
+    size_t len = 0;
+    int i, a;
+
+    if (quiet || n == 0)
+        return;
+
+    for (i = 0; i < n && len < sizeof(buf) - 256; i++) {
+        const struct pen_sample *s = &batch[i];
+
+        len += snprintf(buf + len, sizeof(buf) - len, "%lu device %d",
+                        (unsigned long)s->time, s->deviceid);
+        if (s->touchid >= 0)
+            len += snprintf(buf + len, sizeof(buf) - len, " touch %d",
+                            s->touchid);
+        for (a = 0; a < NAXES; a++)
+            if (s->present & (1 << a))
+                len += snprintf(buf + len, sizeof(buf) - len, " %s %.0f",
+                                axis_labels[a] + 4, s->axes[a]);
+        len += snprintf(buf + len, sizeof(buf) - len, "\n");
+    }
+
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+}
+
+static void print_stats(struct drain_stats *stats, const char *when)
+{
+    double elapsed = now() - stats->start;
+    double per_event;
+
+    if (stats->events == 0) {
+        fprintf(stderr, "%s: no events\n", when);
+        return;
+    }
+
+    per_event = (stats->decode + stats->output) / stats->events;
+    fprintf(stderr, "%s: %.0f events/s, %.1f events/batch (max %d), "
+            "%.0f ns/event in Xlib and decoding, %.0f ns/event output, "
+            "keeps up with %.0f events/s\n", when,
+            stats->events / elapsed,
+            (double)stats->events / stats->batches, stats->max_batch,
+            stats->decode / stats->events * 1e9,
+            stats->output / stats->events * 1e9,
+            1 / per_event);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->start = now();
+}
+
+static void device_changed(Display *dpy, struct device_tracker *tracker,
+                           XIDeviceChangedEvent *event)
+{
+    struct tracked_device *dev = find_device(tracker, event->deviceid);
+    struct valuator_schema *schema;
+
+    if (!dev)
+        return;
+    schema = &dev->schema;
+
+    /* the new classes are in the event, only the labels need the server */
+    printf("Device %d changed\n", event->deviceid);
+    build_schema(dpy, schema, event->deviceid, event->classes, event->num_classes);
+    print_schema(schema);
+}
 
-    printf("    device: %d event type: %d\n", event->deviceid, event->evtype);
+/* Pass a batch to the sink and count it, start is when decoding it began */
+static void flush_batch(const struct pen_sample *batch, int n, int quiet,
+                        struct drain_stats *stats, double start)
+{
+    double decoded = now();
+
+    print_batch(batch, n, quiet);
+
+    if (n > 0) {
+        stats->events += n;
+        stats->batches++;
+        if (n > stats->max_batch)
+            stats->max_batch = n;
+        stats->decode += decoded - start;
+        stats->output += now() - decoded;
+    }
+}
+
+/* Take everything Xlib has queued, without reading from the socket,
+ * decoding raw events into the batch and passing it to the sink */
+static void drain(Display *dpy, int xi_opcode, struct device_tracker *tracker,
+                  struct pen_sample *batch, int quiet, struct drain_stats *stats)
+{
+    double start;
+    XEvent ev;
+    int n = 0;
+
+    start = now();
+    while (n < BATCH_SIZE && XEventsQueued(dpy, QueuedAlready) > 0) {
+        XGenericEventCookie *cookie = &ev.xcookie;
 
-    for (i = 0; i < event->valuators.mask_len * 8; i++) {
-	if (XIMaskIsSet(event->valuators.mask, i)) {
-            printf(" raw valuator %d: %f\n", i, *valuator);
-            valuator++;
+        XNextEvent(dpy, &ev);
+        if (cookie->type != GenericEvent ||
+            cookie->extension != xi_opcode ||
+            !XGetEventData(dpy, cookie))
+            continue;
+
+        switch (cookie->evtype) {
+        case XI_RawMotion:
+        case XI_RawTouchBegin:
+        case XI_RawTouchUpdate:
+        case XI_RawTouchEnd: {
+            XIRawEvent *raw = cookie->data;
+            struct tracked_device *dev = find_device(tracker, raw->deviceid);
+            struct pen_sample *s;
+
+            if (!dev)
+                break;
+
+            s = &batch[n++];
+            s->time = raw->time;
+            s->deviceid = raw->deviceid;
+            s->touchid = cookie->evtype == XI_RawMotion ? -1 : raw->detail;
+            s->present = decode_raw(&dev->schema, raw, s->axes);
+            break;
         }
+        case XI_DeviceChanged:
+            /* what was decoded so far goes out with the old schema */
+            flush_batch(batch, n, quiet, stats, start);
+            n = 0;
+            device_changed(dpy, tracker, cookie->data);
+            start = now();
+            break;
+        case XI_HierarchyChanged:
+            hierarchy_changed(dpy, tracker, cookie->data);
+            break;
+        }
+
+        XFreeEventData(dpy, cookie);
     }
+
+    flush_batch(batch, n, quiet, stats, start);
 }
 
 int main (int argc, char **argv)
 {
     Display *dpy;
     int xi_opcode, event, error;
-    Window win;
-    XEvent ev;
+    int major = 2, minor = 2;
+    static struct device_tracker tracker;
+    static struct pen_sample batch[BATCH_SIZE];
+    struct drain_stats stats = { 0 };
+    struct sigaction sa;
+    struct pollfd pfd;
+    double interval = 5, next;
+    int quiet = 0, opt;
+
+    while ((opt = getopt(argc, argv, "qs:h")) != -1) {
+        switch (opt) {
+        case 'q':
+            quiet = 1;
+            break;
+        case 's':
+            interval = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-q] [-s seconds]\n", argv[0]);
+            return -1;
+        }
+    }
 
     dpy = XOpenDisplay(NULL);
 
@@ -139,24 +730,47 @@ int main (int argc, char **argv)
               return -1;
     }
 
-    win = create_win(dpy);
-
-    while(1) {
-        XGenericEventCookie *cookie = &ev.xcookie;
+    /* 2.2 for raw touch events, a 2.0 server still does the pen */
+    if (XIQueryVersion(dpy, &major, &minor) != Success) {
+        printf("X Input 2 not available.\n");
+        return -1;
+    }
 
-        XNextEvent(dpy, &ev);
-        if (cookie->type != GenericEvent ||
-            cookie->extension != xi_opcode ||
-            !XGetEventData(dpy, cookie))
-            continue;
+    create_win(dpy, &tracker, minor);
+
+    /* no SA_RESTART, Ctrl-C has to interrupt poll() */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sighandler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pfd.fd = ConnectionNumber(dpy);
+    pfd.events = POLLIN;
+    stats.start = now();
+    next = stats.start + interval;
+
+    while (running) {
+        /* only sleep if Xlib has nothing queued already, events read
+         * along with a reply would otherwise wait for the next one */
+        if (XEventsQueued(dpy, QueuedAlready) == 0) {
+            XFlush(dpy);
+            if (poll(&pfd, 1, interval > 0 ? 1000 : -1) < 0)
+                continue;
+            if (pfd.revents & (POLLERR | POLLHUP))
+                break;
+            XEventsQueued(dpy, QueuedAfterReading);
+        }
 
-        if (cookie->evtype == XI_RawMotion)
-                print_rawmotion(cookie->data);
+        drain(dpy, xi_opcode, &tracker, batch, quiet, &stats);
 
-        XFreeEventData(dpy, cookie);
+        if (interval > 0 && now() >= next) {
+            print_stats(&stats, "last interval");
+            next = now() + interval;
+        }
     }
 
+    print_stats(&stats, "since last report");
+    tracker_free(&tracker);
     XCloseDisplay(dpy);
     return 0;
 }
-
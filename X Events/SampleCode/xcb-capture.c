@@ -0,0 +1,542 @@
+/* print raw pen and touch values from Wacom devices, using XCB
+
+To compile:
+	gcc -o xcb-capture xcb-capture.c -lxcb -lxcb-xinput
+
+To run the sample
+	./xcb-capture
+
+Print only the statistics, every 10 seconds instead of 5:
+	./xcb-capture -q -s 10
+
+This is pen-tip-values.c without Xlib. Xlib waits for the reply of
+every request before it sends the next one, XCB hands out a cookie and
+only waits when the reply is asked for. All requests the sample needs
+at startup are sent before any reply is read: the valuator labels are
+interned (not looked up by name, the atoms are compared as numbers)
+together with the query for the extension, the version and device
+queries follow as soon as the extension's opcode is known. That is two
+round trips, where pen-tip-values.c needs about five.
+
+Every Wacom device with a touch class is captured as touch, every one
+with a pressure valuator as a pen. Events are taken with
+xcb_poll_for_event() until none are left and decoded from the wire
+format of the event, no copy into Xlib structs and no allocation per
+valuator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xinput.h>
+
+enum axis {
+    AXIS_X,
+    AXIS_Y,
+    AXIS_PRESSURE,
+    AXIS_TILT_X,
+    AXIS_TILT_Y,
+    AXIS_WHEEL,
+    NAXES
+};
+
+static const char *axis_names[NAXES] = {
+    [AXIS_X] = "X",
+    [AXIS_Y] = "Y",
+    [AXIS_PRESSURE] = "Pressure",
+    [AXIS_TILT_X] = "Tilt X",
+    [AXIS_TILT_Y] = "Tilt Y",
+    [AXIS_WHEEL] = "Wheel",
+};
+
+/* The valuator labels of the wacom and libinput drivers. Touch devices
+ * report their position on the MT axes. */
+static const struct {
+    const char *name;
+    enum axis axis;
+} labels[] = {
+    { "Abs X", AXIS_X },
+    { "Abs Y", AXIS_Y },
+    { "Abs Pressure", AXIS_PRESSURE },
+    { "Abs Tilt X", AXIS_TILT_X },
+    { "Abs Tilt Y", AXIS_TILT_Y },
+    { "Abs Wheel", AXIS_WHEEL },
+    { "Abs MT Position X", AXIS_X },
+    { "Abs MT Position Y", AXIS_Y },
+};
+
+#define NLABELS (sizeof(labels) / sizeof(labels[0]))
+#define MAX_DEVICES 256
+#define MAX_VALUATORS 36
+#define BATCH_SIZE 256
+
+enum kind {
+    DEVICE_NONE,
+    DEVICE_PEN,
+    DEVICE_TOUCH,
+};
+
+struct device {
+    enum kind kind;
+    int slot[MAX_VALUATORS];    /* valuator number -> enum axis, -1 if none */
+};
+
+/* One decoded raw event */
+struct sample {
+    xcb_timestamp_t time;
+    uint16_t deviceid;
+    uint16_t evtype;            /* XCB_INPUT_RAW_* */
+    uint32_t touchid;
+    unsigned int present;       /* 1 << enum axis for each axis in the event */
+    double axes[NAXES];
+};
+
+struct drain_stats {
+    unsigned long events;
+    unsigned long batches;
+    int max_batch;
+    double decode;              /* seconds in XCB and decoding */
+    double output;              /* seconds in the sink */
+    double start;
+};
+
+static xcb_atom_t label_atoms[NLABELS];
+static struct device devices[MAX_DEVICES];  /* indexed by device id */
+static volatile sig_atomic_t running = 1;
+
+static void sighandler(int signal)
+{
+    running = 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double fp3232(xcb_input_fp3232_t v)
+{
+    return v.integral + v.frac / 4294967296.0;
+}
+
+/* Map the valuators of a device to axes and work out what it is. The
+ * labels are atoms, compared with the interned ones, the server isn't
+ * asked for any names. */
+static enum kind build_slots(struct device *dev,
+                             xcb_input_device_class_iterator_t classes)
+{
+    int pressure = 0, touch = 0;
+    unsigned int l;
+    int i;
+
+    for (i = 0; i < MAX_VALUATORS; i++)
+        dev->slot[i] = -1;
+
+    for (; classes.rem; xcb_input_device_class_next(&classes)) {
+        const xcb_input_valuator_class_t *v;
+
+        if (classes.data->type == XCB_INPUT_DEVICE_CLASS_TYPE_TOUCH)
+            touch = 1;
+        if (classes.data->type != XCB_INPUT_DEVICE_CLASS_TYPE_VALUATOR)
+            continue;
+
+        v = (const xcb_input_valuator_class_t *)classes.data;
+        if (v->number >= MAX_VALUATORS || v->label == XCB_ATOM_NONE)
+            continue;
+
+        for (l = 0; l < NLABELS; l++) {
+            if (v->label != label_atoms[l])
+                continue;
+            dev->slot[v->number] = labels[l].axis;
+            if (labels[l].axis == AXIS_PRESSURE)
+                pressure = 1;
+        }
+    }
+
+    return touch ? DEVICE_TOUCH : pressure ? DEVICE_PEN : DEVICE_NONE;
+}
+
+/* Send everything, then collect the replies. Selects the raw events of
+ * all Wacom pen and touch devices on the root window. */
+static int setup(xcb_connection_t *c, xcb_window_t root, uint8_t *xi_opcode)
+{
+    xcb_intern_atom_cookie_t atom_cookies[NLABELS];
+    const xcb_query_extension_reply_t *ext;
+    xcb_input_xi_query_version_cookie_t version_cookie;
+    xcb_input_xi_query_version_reply_t *version;
+    xcb_input_xi_query_device_cookie_t device_cookie;
+    xcb_input_xi_query_device_reply_t *reply;
+    xcb_input_xi_device_info_iterator_t it;
+    struct {
+        xcb_input_event_mask_t head;
+        uint32_t mask;
+    } masks[MAX_DEVICES];
+    unsigned int l;
+    int nmasks = 0;
+
+    /* the atoms go out with the QueryExtension... */
+    xcb_prefetch_extension_data(c, &xcb_input_id);
+    for (l = 0; l < NLABELS; l++)
+        atom_cookies[l] = xcb_intern_atom(c, 1, strlen(labels[l].name),
+                                          labels[l].name);
+
+    /* ...whose reply is needed to encode any XI request */
+    ext = xcb_get_extension_data(c, &xcb_input_id);
+    if (!ext || !ext->present) {
+        printf("X Input extension not available.\n");
+        return -1;
+    }
+    *xi_opcode = ext->major_opcode;
+
+    /* raw touch events need 2.2 */
+    version_cookie = xcb_input_xi_query_version(c, 2, 2);
+    device_cookie = xcb_input_xi_query_device(c, XCB_INPUT_DEVICE_ALL);
+
+    for (l = 0; l < NLABELS; l++) {
+        xcb_intern_atom_reply_t *atom;
+
+        atom = xcb_intern_atom_reply(c, atom_cookies[l], NULL);
+        label_atoms[l] = atom ? atom->atom : XCB_ATOM_NONE;
+        free(atom);
+    }
+
+    version = xcb_input_xi_query_version_reply(c, version_cookie, NULL);
+    if (!version || version->major_version < 2 ||
+        (version->major_version == 2 && version->minor_version < 2)) {
+        printf("X Input 2.2 not available.\n");
+        free(version);
+        return -1;
+    }
+    free(version);
+
+    reply = xcb_input_xi_query_device_reply(c, device_cookie, NULL);
+    if (!reply)
+        return -1;
+
+    for (it = xcb_input_xi_query_device_infos_iterator(reply); it.rem;
+         xcb_input_xi_device_info_next(&it)) {
+        const xcb_input_xi_device_info_t *info = it.data;
+        const char *name = xcb_input_xi_device_info_name(info);
+        int len = xcb_input_xi_device_info_name_length(info);
+        struct device *dev;
+
+        if (info->deviceid >= MAX_DEVICES ||
+            info->type == XCB_INPUT_DEVICE_TYPE_MASTER_POINTER ||
+            info->type == XCB_INPUT_DEVICE_TYPE_MASTER_KEYBOARD ||
+            len < 5 || strncmp("Wacom", name, 5) != 0)
+            continue;
+
+        dev = &devices[info->deviceid];
+        dev->kind = build_slots(dev, xcb_input_xi_device_info_classes_iterator(info));
+        if (dev->kind == DEVICE_NONE)
+            continue;
+
+        printf("%s: '%.*s' (%d)\n", dev->kind == DEVICE_PEN ? "Pen" : "Touch",
+               len, name, info->deviceid);
+
+        masks[nmasks].head.deviceid = info->deviceid;
+        masks[nmasks].head.mask_len = 1;
+        /* the tool or its axes changed, the slots have to be rebuilt */
+        masks[nmasks].mask = XCB_INPUT_XI_EVENT_MASK_DEVICE_CHANGED;
+        if (dev->kind == DEVICE_PEN)
+            masks[nmasks].mask |= XCB_INPUT_XI_EVENT_MASK_RAW_MOTION;
+        else
+            masks[nmasks].mask |= XCB_INPUT_XI_EVENT_MASK_RAW_TOUCH_BEGIN |
+                                  XCB_INPUT_XI_EVENT_MASK_RAW_TOUCH_UPDATE |
+                                  XCB_INPUT_XI_EVENT_MASK_RAW_TOUCH_END;
+        nmasks++;
+    }
+    free(reply);
+
+    if (nmasks == 0) {
+        printf("no tablet connected\n");
+        return -1;
+    }
+
+    /* raw events are only ever delivered to the root window */
+    xcb_input_xi_select_events(c, root, nmasks, &masks[0].head);
+    xcb_flush(c);
+    return 0;
+}
+
+/* Decode the valuators of a raw event in place. The mask is a bit per
+ * valuator, the values are packed, one for every bit that is set. */
+static unsigned int decode_raw(const struct device *dev, const uint32_t *mask,
+                               int mask_len, const xcb_input_fp3232_t *values,
+                               double axes[NAXES])
+{
+    unsigned int present = 0;
+    int w, number, slot;
+
+    for (w = 0; w < mask_len; w++) {
+        uint32_t bits = mask[w];
+
+        while (bits) {
+            number = w * 32 + ffs(bits) - 1;
+            bits &= bits - 1;
+
+            slot = number < MAX_VALUATORS ? dev->slot[number] : -1;
+            if (slot >= 0) {
+                axes[slot] = fp3232(*values);
+                present |= 1 << slot;
+            }
+            values++;
+        }
+    }
+
+    return present;
+}
+
+/* The sink: format a whole batch into one buffer, one write */
+static void print_batch(const struct sample *batch, int n, int quiet)
+{
+    static char buf[BATCH_SIZE * 256];
+    size_t len = 0;
+    int i, a;
+
+    if (quiet || n == 0)
+        return;
+
+    for (i = 0; i < n && len < sizeof(buf) - 256; i++) {
+        const struct sample *s = &batch[i];
+
+        len += snprintf(buf + len, sizeof(buf) - len, "%u device %d",
+                        s->time, s->deviceid);
+        if (s->evtype != XCB_INPUT_RAW_MOTION)
+            len += snprintf(buf + len, sizeof(buf) - len, " touch %u %s",
+                            s->touchid,
+                            s->evtype == XCB_INPUT_RAW_TOUCH_BEGIN ? "begin" :
+                            s->evtype == XCB_INPUT_RAW_TOUCH_END ? "end" : "update");
+        for (a = 0; a < NAXES; a++)
+            if (s->present & (1 << a))
+                len += snprintf(buf + len, sizeof(buf) - len, " %s %.0f",
+                                axis_names[a], s->axes[a]);
+        len += snprintf(buf + len, sizeof(buf) - len, "\n");
+    }
+
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+}
+
+static void print_stats(struct drain_stats *stats, const char *when)
+{
+    double elapsed = now() - stats->start;
+    double per_event;
+
+    if (stats->events == 0) {
+        fprintf(stderr, "%s: no events\n", when);
+        return;
+    }
+
+    per_event = (stats->decode + stats->output) / stats->events;
+    fprintf(stderr, "%s: %.0f events/s, %.1f events/batch (max %d), "
+            "%.0f ns/event in XCB and decoding, %.0f ns/event output, "
+            "keeps up with %.0f events/s\n", when,
+            stats->events / elapsed,
+            (double)stats->events / stats->batches, stats->max_batch,
+            stats->decode / stats->events * 1e9,
+            stats->output / stats->events * 1e9,
+            1 / per_event);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->start = now();
+}
+
+static void device_changed(const xcb_input_device_changed_event_t *event)
+{
+    struct device *dev;
+
+    if (event->deviceid >= MAX_DEVICES)
+        return;
+    dev = &devices[event->deviceid];
+    if (dev->kind == DEVICE_NONE)
+        return;
+
+    /* the new classes are in the event, the atoms are known already */
+    printf("Device %d changed\n", event->deviceid);
+    build_slots(dev, xcb_input_device_changed_classes_iterator(event));
+}
+
+/* Decode a raw event into the next sample, 0 if it isn't one of ours */
+static int decode_event(const xcb_ge_generic_event_t *ge, struct sample *s)
+{
+    /* raw motion and raw touch events have the same layout */
+    const xcb_input_raw_button_press_event_t *raw = (const void *)ge;
+    const xcb_input_raw_touch_begin_event_t *touch = (const void *)ge;
+    const struct device *dev;
+
+    if (raw->deviceid >= MAX_DEVICES)
+        return 0;
+    dev = &devices[raw->deviceid];
+
+    s->time = raw->time;
+    s->deviceid = raw->deviceid;
+    s->evtype = ge->event_type;
+    s->touchid = raw->detail;
+
+    if (ge->event_type == XCB_INPUT_RAW_MOTION) {
+        if (dev->kind != DEVICE_PEN)
+            return 0;
+        s->present = decode_raw(dev, xcb_input_raw_button_press_valuator_mask(raw),
+                                raw->valuators_len,
+                                xcb_input_raw_button_press_axisvalues(raw),
+                                s->axes);
+    } else {
+        if (dev->kind != DEVICE_TOUCH)
+            return 0;
+        s->present = decode_raw(dev, xcb_input_raw_touch_begin_valuator_mask(touch),
+                                touch->valuators_len,
+                                xcb_input_raw_touch_begin_axisvalues(touch),
+                                s->axes);
+    }
+
+    return 1;
+}
+
+/* Pass a batch to the sink and count it, start is when decoding it began */
+static void flush_batch(const struct sample *batch, int n, int quiet,
+                        struct drain_stats *stats, double start)
+{
+    double decoded = now();
+
+    print_batch(batch, n, quiet);
+
+    if (n > 0) {
+        stats->events += n;
+        stats->batches++;
+        if (n > stats->max_batch)
+            stats->max_batch = n;
+        stats->decode += decoded - start;
+        stats->output += now() - decoded;
+    }
+}
+
+/* Take the events XCB has, reading the socket without blocking, decode
+ * the raw ones into the batch and pass it to the sink. Returns 1 if the
+ * batch filled up and more events may be waiting. */
+static int drain(xcb_connection_t *c, uint8_t xi_opcode, struct sample *batch,
+                 int quiet, struct drain_stats *stats)
+{
+    xcb_generic_event_t *ev;
+    double start;
+    int n = 0;
+
+    start = now();
+    while (n < BATCH_SIZE && (ev = xcb_poll_for_event(c))) {
+        const xcb_ge_generic_event_t *ge = (const void *)ev;
+        int type = ev->response_type & ~0x80;
+
+        if (type == 0) {
+            const xcb_generic_error_t *error = (const void *)ev;
+
+            fprintf(stderr, "X error %d, request %d.%d\n", error->error_code,
+                    error->major_code, error->minor_code);
+        } else if (type == XCB_GE_GENERIC && ge->extension == xi_opcode) {
+            switch (ge->event_type) {
+            case XCB_INPUT_RAW_MOTION:
+            case XCB_INPUT_RAW_TOUCH_BEGIN:
+            case XCB_INPUT_RAW_TOUCH_UPDATE:
+            case XCB_INPUT_RAW_TOUCH_END:
+                n += decode_event(ge, &batch[n]);
+                break;
+            case XCB_INPUT_DEVICE_CHANGED:
+                /* what was decoded so far goes out with the old slots */
+                flush_batch(batch, n, quiet, stats, start);
+                n = 0;
+                device_changed((const void *)ev);
+                start = now();
+                break;
+            }
+        }
+
+        free(ev);
+    }
+
+    flush_batch(batch, n, quiet, stats, start);
+
+    return n == BATCH_SIZE;
+}
+
+int main(int argc, char **argv)
+{
+    xcb_connection_t *c;
+    xcb_screen_iterator_t screens;
+    static struct sample batch[BATCH_SIZE];
+    struct drain_stats stats = { 0 };
+    struct sigaction sa;
+    struct pollfd pfd;
+    double interval = 5, next;
+    uint8_t xi_opcode;
+    int screen, quiet = 0, more = 1, opt;
+
+    while ((opt = getopt(argc, argv, "qs:h")) != -1) {
+        switch (opt) {
+        case 'q':
+            quiet = 1;
+            break;
+        case 's':
+            interval = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-q] [-s seconds]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    c = xcb_connect(NULL, &screen);
+    if (xcb_connection_has_error(c)) {
+        fprintf(stderr, "Failed to open display.\n");
+        return -1;
+    }
+
+    screens = xcb_setup_roots_iterator(xcb_get_setup(c));
+    while (screen-- > 0)
+        xcb_screen_next(&screens);
+
+    if (setup(c, screens.data->root, &xi_opcode) < 0) {
+        xcb_disconnect(c);
+        return -1;
+    }
+
+    /* no SA_RESTART, Ctrl-C has to interrupt poll() */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sighandler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pfd.fd = xcb_get_file_descriptor(c);
+    pfd.events = POLLIN;
+    stats.start = now();
+    next = stats.start + interval;
+
+    while (running && !xcb_connection_has_error(c)) {
+        /* a full batch may have left events in XCB's queue, the
+         * socket wouldn't wake us up for those */
+        if (!more) {
+            if (poll(&pfd, 1, interval > 0 ? 1000 : -1) < 0)
+                continue;
+            if (pfd.revents & (POLLERR | POLLHUP))
+                break;
+        }
+
+        more = drain(c, xi_opcode, batch, quiet, &stats);
+
+        if (interval > 0 && now() >= next) {
+            print_stats(&stats, "last interval");
+            next = now() + interval;
+        }
+    }
+
+    print_stats(&stats, "since last report");
+    xcb_disconnect(c);
+    return 0;
+}